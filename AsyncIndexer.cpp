@@ -0,0 +1,141 @@
+#include "AsyncIndexer.h"
+#include "LinkTracker.h"
+#include <stdexcept>
+
+// Closes a search handle even when the consumer abandons the generator mid-directory
+struct CFindHandle
+{
+    HANDLE handle;
+
+    ~CFindHandle()
+    {
+        if (handle != INVALID_HANDLE_VALUE) FindClose(handle);
+    }
+};
+
+CGenerator<vector<IndexRecord>> IndexDirectoryAsync(wstring root, AsyncIndexOptions options)
+{
+    typedef chrono::steady_clock clock;
+    const clock::time_point start = clock::now();
+    clock::time_point lastReport = start;
+
+    IndexProgress progress;
+    vector<IndexRecord> batch;
+    batch.reserve(options.batchSize);
+
+    // Fill in the rates and ETA, then hand the snapshot to the callback
+    auto report = [&](clock::time_point now)
+        {
+            double elapsed = chrono::duration<double>(now - start).count();
+            if (elapsed > 0)
+            {
+                progress.directoriesPerSecond = progress.directoriesDone / elapsed;
+                progress.filesPerSecond = progress.filesDone / elapsed;
+            }
+            progress.etaSeconds = (progress.directoriesPerSecond > 0) ? progress.directoriesPending / progress.directoriesPerSecond : -1;
+            lastReport = now;
+            if (options.onProgress) options.onProgress(progress);
+        };
+
+    // Cancellation and the deadline are checked before every entry, so a large directory cannot delay the stop
+    auto bStopRequested = [&]()
+        {
+            if (options.cancellation != nullptr && options.cancellation->IsCancelled())
+            {
+                progress.status = WalkStatus::Cancelled;
+            }
+            else if (clock::now() >= options.deadline)
+            {
+                progress.status = WalkStatus::DeadlineExceeded;
+            }
+            return progress.status != WalkStatus::Running;
+        };
+
+    // Junctions are always checked for cycles; the rules decide whether links are followed and hard links merged
+    CLinkTracker links(options.filter != nullptr ? options.filter->Rules() : FilterRules());
+    links.AddRoot(root);
+
+    // Explicit stack of (directory, depth) so the walk can suspend between any two entries
+    vector<pair<wstring, int>> pending;
+    pending.push_back({ root, 0 });
+    bool isRoot = true;
+
+    while (!pending.empty())
+    {
+        if (bStopRequested()) break;
+
+        clock::time_point now = clock::now();
+        if (now - lastReport >= options.progressInterval)
+        {
+            progress.directoriesPending = pending.size();
+            report(now);
+        }
+
+        wstring directory = move(pending.back().first);
+        int depth = pending.back().second;
+        pending.pop_back();
+
+        WIN32_FIND_DATA findFileData;
+        wstring searchPath = directory + L"\\*";
+        CFindHandle hFind{ FindFirstFileEx(searchPath.c_str(), FindExInfoBasic, &findFileData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH) };
+
+        if (hFind.handle == INVALID_HANDLE_VALUE)
+        {
+            if (isRoot) throw runtime_error("Invalid handle value. Directory not found or access denied.");
+            continue;
+        }
+        isRoot = false;
+
+        do
+        {
+            // A batch handed over may have given the consumer time to cancel
+            if (bStopRequested()) break;
+
+            // Ignore "." and ".." directories
+            if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (options.filter == nullptr || options.filter->bAcceptDirectory(findFileData, depth + 1))
+                {
+                    wstring subdirectory = directory + L"\\" + findFileData.cFileName;
+                    if (links.bEnterDirectory(subdirectory, findFileData)) pending.push_back({ move(subdirectory), depth + 1 });
+                }
+            }
+            else if (options.filter == nullptr || options.filter->bAcceptFile(findFileData))
+            {
+                // Skip further hard links to a file already indexed
+                wstring filePath = directory + L"\\" + findFileData.cFileName;
+                uint64_t fileId;
+                if (!links.bAcceptFile(filePath, fileId)) continue;
+
+                IndexRecord record = IndexRecord::FromFindData(filePath, findFileData, 0);
+                record.fileId = fileId;
+                batch.push_back(move(record));
+                progress.filesDone++;
+
+                // Hand over a full batch; the search handle stays open across the suspension
+                if (batch.size() >= options.batchSize)
+                {
+                    vector<IndexRecord> full;
+                    full.reserve(options.batchSize);
+                    full.swap(batch);
+                    co_yield move(full);
+                }
+            }
+        } while (FindNextFile(hFind.handle, &findFileData) != 0);
+
+        // A directory left part way through is not counted as done
+        if (progress.status != WalkStatus::Running) break;
+        progress.directoriesDone++;
+    }
+
+    if (!batch.empty())
+    {
+        co_yield move(batch);
+    }
+
+    if (progress.status == WalkStatus::Running) progress.status = WalkStatus::Completed;
+    progress.directoriesPending = pending.size();
+    report(clock::now());
+}
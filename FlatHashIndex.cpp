@@ -0,0 +1,153 @@
+#include "FlatHashIndex.h"
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+uint32_t CFlatHashIndex::AddDirectory(uint32_t parent, const wchar_t* name, size_t length)
+{
+    if (length > MAX_NAME_LENGTH)
+    {
+        throw runtime_error("Directory name too long for the flat index");
+    }
+    if (directoryParents.size() >= NO_DIRECTORY || names.size() + length > MAX_ENTRIES)
+    {
+        throw runtime_error("Too many directories or name characters for the flat index");
+    }
+
+    uint32_t directory = static_cast<uint32_t>(directoryParents.size());
+    directoryParents.push_back(parent);
+    directoryNameOffsets.push_back(static_cast<uint32_t>(names.size()));
+    directoryNameLengths.push_back(static_cast<uint16_t>(length));
+    names.insert(names.end(), name, name + length);
+    return directory;
+}
+
+void CFlatHashIndex::AddFile(uint32_t directory, const wchar_t* name, size_t length, size_t hash)
+{
+    if (length > MAX_NAME_LENGTH || hash > 0xFFFFFFFFull)
+    {
+        throw runtime_error("File name or hash out of range for the flat index");
+    }
+    if (hashes.size() >= MAX_ENTRIES || names.size() + length > MAX_ENTRIES)
+    {
+        throw runtime_error("Too many files or name characters for the flat index");
+    }
+
+    hashes.push_back(static_cast<uint32_t>(hash));
+    fileDirectories.push_back(directory);
+    nameOffsets.push_back(static_cast<uint32_t>(names.size()));
+    nameLengths.push_back(static_cast<uint16_t>(length));
+    names.insert(names.end(), name, name + length);
+}
+
+void CFlatHashIndex::Reserve(size_t files, size_t nameCharacters)
+{
+    hashes.reserve(files);
+    fileDirectories.reserve(files);
+    nameOffsets.reserve(files);
+    nameLengths.reserve(files);
+    names.reserve(nameCharacters);
+}
+
+void CFlatHashIndex::AppendFiles(CFlatHashIndex& other)
+{
+    if (hashes.size() + other.hashes.size() > MAX_ENTRIES || names.size() + other.names.size() > MAX_ENTRIES)
+    {
+        throw runtime_error("Too many files or name characters for the flat index");
+    }
+
+    // Callers merging several indexes reserve their totals first; a reserve per append would copy every time
+    size_t base = names.size();
+
+    hashes.insert(hashes.end(), other.hashes.begin(), other.hashes.end());
+    fileDirectories.insert(fileDirectories.end(), other.fileDirectories.begin(), other.fileDirectories.end());
+    nameLengths.insert(nameLengths.end(), other.nameLengths.begin(), other.nameLengths.end());
+    names.insert(names.end(), other.names.begin(), other.names.end());
+
+    // Names moved into this pool, so rebase their offsets
+    for (uint32_t offset : other.nameOffsets)
+    {
+        nameOffsets.push_back(static_cast<uint32_t>(base + offset));
+    }
+
+    other = CFlatHashIndex();
+}
+
+void CFlatHashIndex::Finalize()
+{
+    const size_t count = hashes.size();
+
+    // Sort (hash, slot) pairs packed into one integer, then gather every array through the permutation
+    vector<uint64_t> order(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i] = (uint64_t(hashes[i]) << 32) | i;
+    }
+    sort(order.begin(), order.end());
+
+    auto gather = [&](auto& column)
+        {
+            typename remove_reference<decltype(column)>::type sorted(count);
+            for (size_t i = 0; i < count; i++) sorted[i] = column[static_cast<uint32_t>(order[i])];
+            column.swap(sorted);
+        };
+    gather(hashes);
+    gather(fileDirectories);
+    gather(nameOffsets);
+    gather(nameLengths);
+
+    // Buckets split [0, largest hash] evenly, whatever range the hash function covers
+    hashRange = (count == 0) ? 1 : uint64_t(hashes.back()) + 1;
+
+    // About one bucket per file, rounded to a power of two
+    bucketCount = 1;
+    while (bucketCount < count) bucketCount <<= 1;
+
+    // Counting pass over the sorted hashes gives each bucket's start
+    buckets.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i < count; i++) buckets[Bucket(hashes[i]) + 1]++;
+    for (size_t b = 0; b < bucketCount; b++) buckets[b + 1] += buckets[b];
+}
+
+pair<size_t, size_t> CFlatHashIndex::Find(size_t hash) const
+{
+    if (buckets.empty() || hash >= hashRange) return { 0, 0 };
+
+    size_t bucket = Bucket(static_cast<uint32_t>(hash));
+    size_t first = buckets[bucket];
+    size_t last = buckets[bucket + 1];
+
+    // The bucket is short and contiguous; scan it for the exact hash
+    while (first < last && hashes[first] < hash) first++;
+    size_t end = first;
+    while (end < last && hashes[end] == hash) end++;
+    return { first, end };
+}
+
+void CFlatHashIndex::AppendDirectoryPath(uint32_t directory, wstring& out) const
+{
+    if (directoryParents[directory] != NO_DIRECTORY)
+    {
+        AppendDirectoryPath(directoryParents[directory], out);
+        out.push_back(L'\\');
+    }
+    const wchar_t* name = names.data() + directoryNameOffsets[directory];
+    out.append(name, name + directoryNameLengths[directory]);
+}
+
+void CFlatHashIndex::AppendPath(size_t entry, wstring& out) const
+{
+    AppendDirectoryPath(fileDirectories[entry], out);
+    out.push_back(L'\\');
+    const wchar_t* name = names.data() + nameOffsets[entry];
+    out.append(name, name + nameLengths[entry]);
+}
+
+size_t CFlatHashIndex::MemoryUsage() const
+{
+    return hashes.capacity() * sizeof(uint32_t) + fileDirectories.capacity() * sizeof(uint32_t) +
+        nameOffsets.capacity() * sizeof(uint32_t) + nameLengths.capacity() * sizeof(uint16_t) +
+        directoryParents.capacity() * sizeof(uint32_t) + directoryNameOffsets.capacity() * sizeof(uint32_t) +
+        directoryNameLengths.capacity() * sizeof(uint16_t) + names.capacity() * sizeof(wchar_t) +
+        buckets.capacity() * sizeof(uint32_t);
+}
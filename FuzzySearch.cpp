@@ -0,0 +1,309 @@
+#include "FuzzySearch.h"
+#include "IndexFile.h"
+#include "NameKey.h"
+#include <windows.h>
+#include <io.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+uint64_t CFuzzyNameIndex::Trigram(const wchar_t* text)
+{
+    return (uint64_t(uint16_t(text[0])) << 32) | (uint64_t(uint16_t(text[1])) << 16) | uint64_t(uint16_t(text[2]));
+}
+
+void CFuzzyNameIndex::Add(const wstring& filePath)
+{
+    uint32_t fileId = static_cast<uint32_t>(paths.size());
+    size_t separator = filePath.find_last_of(L"\\/");
+
+    // Names are matched on their folded form, case- and normalization-insensitively
+    wstring name = FoldName((separator == wstring::npos) ? filePath : filePath.substr(separator + 1));
+
+    paths.push_back(filePath);
+    depths.push_back(static_cast<uint16_t>(count_if(filePath.begin(), filePath.end(), [](wchar_t c) { return c == L'\\' || c == L'/'; })));
+
+    // Each distinct trigram of the name gets one posting
+    for (size_t i = 0; i + 3 <= name.size(); i++)
+    {
+        vector<uint32_t>& postings = trigrams[Trigram(name.c_str() + i)];
+        if (postings.empty() || postings.back() != fileId) postings.push_back(fileId);
+    }
+    names.push_back(move(name));
+}
+
+int CFuzzyNameIndex::BitParallelDistance(const wstring& pattern, const wstring& text, int maxDistance, bool damerau)
+{
+    const size_t m = pattern.size();
+    const uint64_t highBit = uint64_t(1) << (m - 1);
+
+    // Match masks: ASCII through a table, anything else through a small map
+    uint64_t asciiPeq[128] = {};
+    unordered_map<wchar_t, uint64_t> otherPeq;
+    for (size_t i = 0; i < m; i++)
+    {
+        if (pattern[i] < 128) asciiPeq[pattern[i]] |= uint64_t(1) << i;
+        else otherPeq[pattern[i]] |= uint64_t(1) << i;
+    }
+
+    uint64_t vp = ~uint64_t(0), vn = 0, d0 = 0, previousEq = 0;
+    int score = static_cast<int>(m);
+
+    for (size_t j = 0; j < text.size(); j++)
+    {
+        wchar_t c = text[j];
+        uint64_t eq = 0;
+        if (c < 128)
+        {
+            eq = asciiPeq[c];
+        }
+        else if (!otherPeq.empty())
+        {
+            auto found = otherPeq.find(c);
+            if (found != otherPeq.end()) eq = found->second;
+        }
+
+        // Hyyro's transposition term: an adjacent swap of the previous and current characters
+        uint64_t transposition = damerau ? ((((~d0) & eq) << 1) & previousEq) : 0;
+
+        d0 = (((eq & vp) + vp) ^ vp) | eq | vn | transposition;
+        uint64_t hp = vn | ~(d0 | vp);
+        uint64_t hn = vp & d0;
+
+        if (hp & highBit) score++;
+        else if (hn & highBit) score--;
+
+        // The score drops by at most one per remaining character
+        if (score - static_cast<int>(text.size() - j - 1) > maxDistance) return maxDistance + 1;
+
+        hp = (hp << 1) | 1;
+        hn <<= 1;
+        vp = hn | ~(d0 | hp);
+        vn = hp & d0;
+        previousEq = eq;
+    }
+    return score;
+}
+
+int CFuzzyNameIndex::DynamicDistance(const wstring& a, const wstring& b, int maxDistance, bool damerau)
+{
+    vector<int> previous2(b.size() + 1), previous(b.size() + 1), current(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) previous[j] = static_cast<int>(j);
+
+    for (size_t i = 1; i <= a.size(); i++)
+    {
+        current[0] = static_cast<int>(i);
+        int rowMinimum = current[0];
+        for (size_t j = 1; j <= b.size(); j++)
+        {
+            int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            current[j] = min({ previous[j] + 1, current[j - 1] + 1, previous[j - 1] + cost });
+            if (damerau && i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+            {
+                current[j] = min(current[j], previous2[j - 2] + 1);
+            }
+            rowMinimum = min(rowMinimum, current[j]);
+        }
+        if (rowMinimum > maxDistance) return maxDistance + 1;
+
+        previous2.swap(previous);
+        previous.swap(current);
+    }
+    return min(previous[b.size()], maxDistance + 1);
+}
+
+int CFuzzyNameIndex::Distance(const wstring& a, const wstring& b, int maxDistance, bool damerau)
+{
+    // Distance is at least the length difference
+    int lengthDifference = abs(static_cast<int>(a.size()) - static_cast<int>(b.size()));
+    if (lengthDifference > maxDistance) return maxDistance + 1;
+
+    if (a.empty()) return static_cast<int>(b.size());
+    if (a.size() <= 64) return min(BitParallelDistance(a, b, maxDistance, damerau), maxDistance + 1);
+    return DynamicDistance(a, b, maxDistance, damerau);
+}
+
+vector<FuzzyMatch> CFuzzyNameIndex::Search(const wstring& query, int maxDistance, bool damerau, size_t maxResults) const
+{
+    wstring pattern = FoldName(query);
+
+    vector<FuzzyMatch> matches;
+    auto consider = [&](uint32_t fileId)
+        {
+            int distance = Distance(pattern, names[fileId], maxDistance, damerau);
+            if (distance <= maxDistance) matches.push_back({ fileId, distance, depths[fileId] });
+        };
+
+    // Postings record whether a name contains a trigram, not how often, so the bound is taken over
+    // the pattern's distinct trigrams
+    vector<uint64_t> patternTrigrams;
+    for (size_t i = 0; i + 3 <= pattern.size(); i++) patternTrigrams.push_back(Trigram(pattern.c_str() + i));
+    sort(patternTrigrams.begin(), patternTrigrams.end());
+    patternTrigrams.erase(unique(patternTrigrams.begin(), patternTrigrams.end()), patternTrigrams.end());
+
+    // q-gram lemma: each edit destroys at most three trigram occurrences, so at most three distinct
+    // trigrams disappear. A transposition counts as one edit but can destroy four, so Damerau search
+    // uses the weaker bound
+    int trigramCount = static_cast<int>(patternTrigrams.size());
+    int required = trigramCount - (damerau ? 4 : 3) * maxDistance;
+
+    if (required <= 0)
+    {
+        // The prefilter cannot rule anything out, so scan with the length filter only
+        for (uint32_t fileId = 0; fileId < names.size(); fileId++) consider(fileId);
+    }
+    else
+    {
+        // Count shared distinct trigrams per name and verify only names that reach the bound
+        unordered_map<uint32_t, int> shared;
+        for (uint64_t trigram : patternTrigrams)
+        {
+            auto postings = trigrams.find(trigram);
+            if (postings == trigrams.end()) continue;
+            for (uint32_t fileId : postings->second) shared[fileId]++;
+        }
+
+        for (const auto& candidate : shared)
+        {
+            if (candidate.second >= required) consider(candidate.first);
+        }
+    }
+
+    sort(matches.begin(), matches.end(), [this](const FuzzyMatch& a, const FuzzyMatch& b)
+        {
+            if (a.distance != b.distance) return a.distance < b.distance;
+            if (a.depth != b.depth) return a.depth < b.depth;
+            return paths[a.fileId] < paths[b.fileId];
+        });
+
+    if (maxResults != 0 && matches.size() > maxResults) matches.resize(maxResults);
+    return matches;
+}
+
+// File layout: magic, file count, then per file its depth, path and folded name, then the trigram
+// postings. Every count is checked against the bytes left, so a corrupt file cannot request a huge allocation
+static const char FUZZY_MAGIC[4] = { 'F', 'Z', 'N', 'I' };
+
+void CFuzzyNameIndex::Save(const wstring& filePath) const
+{
+    FILE* file = _wfopen(filePath.c_str(), L"wb");
+    if (file == nullptr)
+    {
+        throw runtime_error("Cannot create fuzzy name index file");
+    }
+
+    auto writeString = [file](const wstring& text)
+        {
+            uint32_t length = static_cast<uint32_t>(text.size());
+            fwrite(&length, sizeof(length), 1, file);
+            fwrite(text.data(), sizeof(wchar_t), length, file);
+        };
+
+    uint32_t fileCount = static_cast<uint32_t>(paths.size());
+    fwrite(FUZZY_MAGIC, 1, sizeof(FUZZY_MAGIC), file);
+    fwrite(&fileCount, sizeof(fileCount), 1, file);
+    for (uint32_t fileId = 0; fileId < fileCount; fileId++)
+    {
+        fwrite(&depths[fileId], sizeof(uint16_t), 1, file);
+        writeString(paths[fileId]);
+        writeString(names[fileId]);
+    }
+
+    uint32_t trigramCount = static_cast<uint32_t>(trigrams.size());
+    fwrite(&trigramCount, sizeof(trigramCount), 1, file);
+    for (const auto& entry : trigrams)
+    {
+        uint32_t postingCount = static_cast<uint32_t>(entry.second.size());
+        fwrite(&entry.first, sizeof(entry.first), 1, file);
+        fwrite(&postingCount, sizeof(postingCount), 1, file);
+        fwrite(entry.second.data(), sizeof(uint32_t), postingCount, file);
+    }
+
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+    {
+        throw runtime_error("Cannot write fuzzy name index file");
+    }
+}
+
+bool CFuzzyNameIndex::Load(const wstring& filePath)
+{
+    FILE* file = _wfopen(filePath.c_str(), L"rb");
+    if (file == nullptr) return false;
+
+    _fseeki64(file, 0, SEEK_END);
+    long long fileSize = _ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+    auto fits = [&](uint64_t count, size_t elementSize) { return count * elementSize <= uint64_t(fileSize - _ftelli64(file)); };
+
+    auto readString = [&](wstring& text)
+        {
+            uint32_t length = 0;
+            if (fread(&length, sizeof(length), 1, file) != 1 || !fits(length, sizeof(wchar_t))) return false;
+            text.resize(length);
+            return fread(&text[0], sizeof(wchar_t), length, file) == length;
+        };
+
+    char magic[4];
+    uint32_t fileCount = 0, trigramCount = 0;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, FUZZY_MAGIC, sizeof(magic)) == 0 &&
+        fread(&fileCount, sizeof(fileCount), 1, file) == 1 && fits(fileCount, sizeof(uint16_t) + 2 * sizeof(uint32_t));
+
+    vector<wstring> loadedPaths(ok ? fileCount : 0), loadedNames(ok ? fileCount : 0);
+    vector<uint16_t> loadedDepths(ok ? fileCount : 0);
+    for (uint32_t fileId = 0; ok && fileId < fileCount; fileId++)
+    {
+        ok = fread(&loadedDepths[fileId], sizeof(uint16_t), 1, file) == 1 && readString(loadedPaths[fileId]) && readString(loadedNames[fileId]);
+    }
+
+    unordered_map<uint64_t, vector<uint32_t>> loadedTrigrams;
+    ok = ok && fread(&trigramCount, sizeof(trigramCount), 1, file) == 1 && fits(trigramCount, sizeof(uint64_t) + sizeof(uint32_t));
+    for (uint32_t i = 0; ok && i < trigramCount; i++)
+    {
+        uint64_t trigram = 0;
+        uint32_t postingCount = 0;
+        ok = fread(&trigram, sizeof(trigram), 1, file) == 1 && fread(&postingCount, sizeof(postingCount), 1, file) == 1 && fits(postingCount, sizeof(uint32_t));
+        if (!ok) break;
+
+        vector<uint32_t>& postings = loadedTrigrams[trigram];
+        postings.resize(postingCount);
+        ok = fread(postings.data(), sizeof(uint32_t), postingCount, file) == postingCount &&
+            all_of(postings.begin(), postings.end(), [fileCount](uint32_t fileId) { return fileId < fileCount; });
+    }
+    fclose(file);
+
+    if (!ok) return false;
+
+    paths.swap(loadedPaths);
+    names.swap(loadedNames);
+    depths.swap(loadedDepths);
+    trigrams.swap(loadedTrigrams);
+    return true;
+}
+
+void CFuzzyNameIndex::WriteSidecar(const wstring& indexPath)
+{
+    CFuzzyNameIndex index;
+    CIndexFileReader reader(indexPath);
+    IndexRecord record;
+    while (reader.Read(record))
+    {
+        index.Add(record.path);
+    }
+    index.Save(SidecarPath(indexPath));
+}
+
+bool CFuzzyNameIndex::LoadSidecar(const wstring& indexPath)
+{
+    // A sidecar older than its index file describes an earlier generation of it
+    WIN32_FILE_ATTRIBUTE_DATA indexData, sidecarData;
+    if (!GetFileAttributesEx(indexPath.c_str(), GetFileExInfoStandard, &indexData) ||
+        !GetFileAttributesEx(SidecarPath(indexPath).c_str(), GetFileExInfoStandard, &sidecarData) ||
+        CompareFileTime(&sidecarData.ftLastWriteTime, &indexData.ftLastWriteTime) < 0)
+    {
+        return false;
+    }
+    return Load(SidecarPath(indexPath));
+}
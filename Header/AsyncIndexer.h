@@ -0,0 +1,135 @@
+#pragma once
+#ifndef ASYNCINDEXER_H
+#define ASYNCINDEXER_H
+
+#define UNICODE
+#include <windows.h>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "IndexFile.h"
+#include "IndexFilter.h"
+
+using namespace std;
+
+// Lazily produced sequence of values; each resume runs the coroutine to its next co_yield
+template <typename T>
+class CGenerator
+{
+public:
+    struct promise_type
+    {
+        T current;
+        exception_ptr error;
+
+        CGenerator get_return_object() { return CGenerator(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        suspend_always yield_value(T value)
+        {
+            current = move(value);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { error = current_exception(); }
+    };
+
+    class iterator
+    {
+    public:
+        explicit iterator(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        T& operator*() const { return handle.promise().current; }
+        iterator& operator++()
+        {
+            Advance(handle);
+            return *this;
+        }
+        bool operator==(default_sentinel_t) const { return !handle || handle.done(); }
+
+    private:
+        coroutine_handle<promise_type> handle;
+    };
+
+    explicit CGenerator(coroutine_handle<promise_type> handle) : handle(handle) {}
+    CGenerator(CGenerator&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    CGenerator(const CGenerator&) = delete;
+    CGenerator& operator=(const CGenerator&) = delete;
+    ~CGenerator()
+    {
+        if (handle) handle.destroy();
+    }
+
+    iterator begin()
+    {
+        Advance(handle);
+        return iterator(handle);
+    }
+    default_sentinel_t end() { return default_sentinel; }
+
+private:
+    // Resume and surface any exception thrown inside the coroutine to the consumer
+    static void Advance(coroutine_handle<promise_type> handle)
+    {
+        handle.resume();
+        if (handle.done() && handle.promise().error) rethrow_exception(exchange(handle.promise().error, nullptr));
+    }
+
+    coroutine_handle<promise_type> handle;
+};
+
+// Cooperative cancellation shared between the consumer and a running walk
+class CCancellationToken
+{
+public:
+    void Cancel() { cancelled.store(true, memory_order_relaxed); }
+    bool IsCancelled() const { return cancelled.load(memory_order_relaxed); }
+
+private:
+    atomic<bool> cancelled{ false };
+};
+
+// Why a walk is (or stopped) running
+enum class WalkStatus { Running, Completed, Cancelled, DeadlineExceeded };
+
+// Progress snapshot passed to the progress callback
+struct IndexProgress
+{
+    WalkStatus status = WalkStatus::Running;
+    size_t directoriesDone = 0;
+    size_t directoriesPending = 0;
+    size_t filesDone = 0;
+    double directoriesPerSecond = 0;
+    double filesPerSecond = 0;
+    double etaSeconds = -1; // Estimated from the discovered-but-unvisited directories, -1 while unknown
+};
+
+// Options for IndexDirectoryAsync
+struct AsyncIndexOptions
+{
+    // Entries per yielded batch
+    size_t batchSize = 256;
+
+    // Include/exclude rules (nullptr indexes everything)
+    const CIndexFilter* filter = nullptr;
+
+    // Checked before every entry; the walk ends early once it is cancelled
+    const CCancellationToken* cancellation = nullptr;
+
+    // The walk ends early once this point in time is passed
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+
+    // Called at most once per interval while walking, and once more when the walk ends
+    function<void(const IndexProgress&)> onProgress;
+    chrono::milliseconds progressInterval = chrono::milliseconds(500);
+};
+
+// Walk the tree under root, yielding indexed entries in batches as they are found
+CGenerator<vector<IndexRecord>> IndexDirectoryAsync(wstring root, AsyncIndexOptions options);
+
+#endif // ASYNCINDEXER_H
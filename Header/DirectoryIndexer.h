@@ -13,6 +13,13 @@
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <memory>
+#include "IndexFilter.h"
+#include "SecondaryIndex.h"
+#include "SpillingIndex.h"
+#include "WorkerPool.h"
+#include "LinkTracker.h"
+#include "SubtreeFilter.h"
 
 // Exception class for directory indexing errors
 class DirectoryIndexingException : public std::exception
@@ -34,38 +41,42 @@ public:
     virtual void IndexDirectory(const std::wstring& directory, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex) = 0;
 };
 
+// Mutex to synchronize access to shared data structures
+extern std::mutex mtx1;
+
 // Derived class implementing B-tree method for directory indexing
 template <typename K, typename V>
 class BtreeSearchIndexer : public DirectoryIndexer<K, V>
 {
 public:
     void IndexDirectory(const std::wstring& directory, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex) override;
-};
 
-#endif // DIRECTORYINDEXER_H
+    // Set the include/exclude rules applied while walking (nullptr indexes everything)
+    void SetFilter(const CIndexFilter* indexFilter) { filter = indexFilter; }
 
-private:
-    string msg;
-};
+    // Also record every indexed file in prefix/extension/name secondary indexes (nullptr to disable)
+    void SetSecondaryIndex(CSecondaryIndex* index) { secondaryIndex = index; }
 
-// Abstract base class for directory indexing using templates
-template <typename K, typename V>
-class DirectoryIndexer
-{
-public:
-    virtual void IndexDirectory(const wstring& directory, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex) = 0;
-};
+    // Send records to a memory-budgeted builder instead of fileIndex (nullptr to disable)
+    void SetSpillBuilder(CSpillingIndexBuilder* builder) { spillBuilder = builder; }
 
-// Mutex to synchronize access to shared data structures
-extern std::mutex mtx1;
+    // Hand each listed directory's file names to a subtree filter builder (nullptr to disable)
+    void SetFilterBuilder(CSubtreeFilterBuilder* builder) { filterBuilder = builder; }
 
-// Derived class implementing btree-search method for directory indexing
-template <typename K, typename V>
-class BtreeSearchIndexer : public DirectoryIndexer<K, V>
-{
-public:
-    void IndexDirectory(const wstring& directory, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex) override;
-};
+    // Set the size and thread placement of the pool that walks subdirectories
+    void SetPoolConfig(const PoolConfig& config) { poolConfig = config; }
 
+private:
+    // Index one directory that lies depth levels below the root
+    void IndexDirectoryAtDepth(const std::wstring& directory, int depth, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex);
+
+    const CIndexFilter* filter = nullptr;
+    CSecondaryIndex* secondaryIndex = nullptr;
+    CSpillingIndexBuilder* spillBuilder = nullptr;
+    CSubtreeFilterBuilder* filterBuilder = nullptr;
+    PoolConfig poolConfig;
+    CWorkerPool* pool = nullptr;
+    CLinkTracker* links = nullptr;
+};
 
 #endif // DIRECTORYINDEXER_H
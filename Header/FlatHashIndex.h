@@ -0,0 +1,81 @@
+#pragma once
+#ifndef FLATHASHINDEX_H
+#define FLATHASHINDEX_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Hash index laid out as parallel arrays: one slot per file holding its hash, directory id and
+// name offset into a shared character pool. Directories are stored once and paths rebuilt on
+// demand, so 10M files take a few hundred MB and a handful of large allocations
+class CFlatHashIndex
+{
+public:
+    static const uint32_t NO_DIRECTORY = 0xFFFFFFFF;
+
+    // Add a directory under parent (NO_DIRECTORY for the root, whose name is its full path)
+    uint32_t AddDirectory(uint32_t parent, const wchar_t* name, size_t length);
+
+    // Add a file; hash must fit in 32 bits, as hash_filename's results do
+    void AddFile(uint32_t directory, const wchar_t* name, size_t length, size_t hash);
+
+    // Move the files of another index in; both must share this index's directory ids
+    void AppendFiles(CFlatHashIndex& other);
+
+    // Size the file arrays and name pool up front, e.g. to the shard totals before appending them
+    void Reserve(size_t files, size_t nameCharacters);
+
+    // Sort the files by hash and build the bucket table; required before lookups
+    void Finalize();
+
+    size_t size() const { return hashes.size(); }
+    size_t NameCharacters() const { return names.size(); }
+    size_t Hash(size_t entry) const { return hashes[entry]; }
+
+    // File name of an entry, not terminated
+    const wchar_t* Name(size_t entry, size_t& length) const { length = nameLengths[entry]; return names.data() + nameOffsets[entry]; }
+
+    // Full path of an entry, appended to out so callers can reuse one buffer
+    void AppendPath(size_t entry, wstring& out) const;
+
+    // First entry and one past the last entry with this hash (equal when there is none)
+    pair<size_t, size_t> Find(size_t hash) const;
+
+    // Bytes held by the arrays
+    size_t MemoryUsage() const;
+
+private:
+    // Slots, offsets and lengths are 32 and 16 bits wide; larger indexes are rejected, not truncated
+    static const uint64_t MAX_ENTRIES = 0xFFFFFFFF;
+    static const size_t MAX_NAME_LENGTH = 0xFFFF;
+
+    size_t Bucket(uint32_t hash) const { return static_cast<size_t>((uint64_t(hash) * bucketCount) / hashRange); }
+    void AppendDirectoryPath(uint32_t directory, wstring& out) const;
+
+    // Files, one slot each
+    vector<uint32_t> hashes;
+    vector<uint32_t> fileDirectories;
+    vector<uint32_t> nameOffsets;
+    vector<uint16_t> nameLengths;
+
+    // Directories, one slot each
+    vector<uint32_t> directoryParents;
+    vector<uint32_t> directoryNameOffsets;
+    vector<uint16_t> directoryNameLengths;
+
+    // Names of files and directories, back to back without terminators
+    vector<wchar_t> names;
+
+    // After Finalize, files with hashes in bucket b occupy [buckets[b], buckets[b + 1]); buckets
+    // split the hash range in order, so each collision chain is one contiguous run
+    vector<uint32_t> buckets;
+    size_t bucketCount = 0;
+    uint64_t hashRange = 1;
+};
+
+#endif // FLATHASHINDEX_H
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef FUZZYSEARCH_H
+#define FUZZYSEARCH_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace std;
+
+// One fuzzy match, ranked by distance and then by path depth
+struct FuzzyMatch
+{
+    uint32_t fileId;
+    int distance;
+    int depth;
+};
+
+// Typo-tolerant filename index: a trigram prefilter in front of a bit-parallel edit-distance kernel
+class CFuzzyNameIndex
+{
+public:
+    // Add a file by its full path; the name after the last separator is what gets matched
+    void Add(const wstring& filePath);
+
+    // Names within maxDistance edits of the query, best first; transpositions count as one
+    // edit when damerau is true. At most maxResults matches are returned (0 for all)
+    vector<FuzzyMatch> Search(const wstring& query, int maxDistance, bool damerau = true, size_t maxResults = 0) const;
+
+    const wstring& Path(uint32_t fileId) const { return paths[fileId]; }
+    size_t size() const { return paths.size(); }
+
+    // Persist the names, depths and trigram postings so a search does not rebuild them
+    void Save(const wstring& filePath) const;
+    bool Load(const wstring& filePath);
+
+    // The fuzzy index is kept next to a persisted index file, in indexPath + ".fuzzy"
+    static wstring SidecarPath(const wstring& indexPath) { return indexPath + L".fuzzy"; }
+
+    // Build the fuzzy index of a persisted index file and save it beside it
+    static void WriteSidecar(const wstring& indexPath);
+
+    // Load the fuzzy index kept beside indexPath; false if there is none or the index file is newer
+    bool LoadSidecar(const wstring& indexPath);
+
+    // Edit distance between a and b, or maxDistance + 1 once it is known to exceed maxDistance
+    static int Distance(const wstring& a, const wstring& b, int maxDistance, bool damerau);
+
+private:
+    // Trigrams of BMP characters packed into one integer
+    static uint64_t Trigram(const wchar_t* text);
+
+    // Myers/Hyyro kernel for patterns of up to 64 characters
+    static int BitParallelDistance(const wstring& pattern, const wstring& text, int maxDistance, bool damerau);
+
+    // Row-by-row dynamic programming for longer patterns
+    static int DynamicDistance(const wstring& a, const wstring& b, int maxDistance, bool damerau);
+
+    vector<wstring> paths;
+    vector<wstring> names;
+    vector<uint16_t> depths;
+    unordered_map<uint64_t, vector<uint32_t>> trigrams;
+};
+
+#endif // FUZZYSEARCH_H
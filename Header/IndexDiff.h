@@ -0,0 +1,49 @@
+#pragma once
+#ifndef INDEXDIFF_H
+#define INDEXDIFF_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <functional>
+#include "IndexFile.h"
+
+using namespace std;
+
+// One difference between two index generations
+struct DiffEntry
+{
+    enum class Kind { Added, Removed, Changed, Moved };
+
+    Kind kind;
+    IndexRecord before; // Empty for Added
+    IndexRecord after;  // Empty for Removed
+};
+
+// Record source over an in-memory index; sorts the records by path on construction
+class CMemoryRecordSource
+{
+public:
+    explicit CMemoryRecordSource(vector<IndexRecord> records);
+
+    bool Read(IndexRecord& record);
+
+private:
+    vector<IndexRecord> records;
+    size_t position = 0;
+};
+
+// Streaming diff of two path-sorted record sources (CIndexFileReader or CMemoryRecordSource)
+template <typename OlderSource, typename NewerSource>
+class CIndexDiff
+{
+public:
+    // Changed entries are reported while merging; moves, additions and removals once both sources are exhausted
+    size_t Compare(OlderSource& older, NewerSource& newer, const function<void(const DiffEntry&)>& report);
+
+private:
+    // Pair removed and added records that are the same file, reporting them as moves
+    void MatchMoves(vector<IndexRecord>& removed, vector<IndexRecord>& added, const function<void(const DiffEntry&)>& report, size_t& differences);
+};
+
+#endif // INDEXDIFF_H
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#define UNICODE
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <windows.h>
+
+using namespace std;
+
+// One indexed file as stored in the persisted index format
+struct IndexRecord
+{
+    wstring path;
+    uint64_t size = 0;
+    uint64_t lastWriteTime = 0; // FILETIME in 100-nanosecond ticks
+    uint64_t fileId = 0;        // Volume-unique file identifier, 0 when unknown
+    uint64_t key = 0;           // Index key produced by the indexer (e.g. the filename hash)
+
+    // Fill size and timestamp from the directory entry the walker already has
+    static IndexRecord FromFindData(const wstring& path, const WIN32_FIND_DATA& findFileData, uint64_t key);
+};
+
+// Persisted indexes are sorted by path
+inline bool operator<(const IndexRecord& a, const IndexRecord& b)
+{
+    return a.path < b.path;
+}
+
+// Sequential writer for the persisted index format: a header followed by records in path order
+class CIndexFileWriter
+{
+public:
+    explicit CIndexFileWriter(const wstring& filePath);
+    ~CIndexFileWriter();
+
+    void Write(const IndexRecord& record);
+    void Close();
+
+private:
+    FILE* file;
+    wstring filePath;
+};
+
+// Sequential reader for files written by CIndexFileWriter
+class CIndexFileReader
+{
+public:
+    explicit CIndexFileReader(const wstring& filePath);
+    ~CIndexFileReader();
+
+    // Read the next record; returns false at end of file
+    bool Read(IndexRecord& record);
+
+private:
+    FILE* file;
+    wstring filePath;
+};
+
+#endif // INDEXFILE_H
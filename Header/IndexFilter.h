@@ -0,0 +1,126 @@
+#pragma once
+#ifndef INDEXFILTER_H
+#define INDEXFILTER_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <windows.h>
+
+using namespace std;
+
+// Include/exclude rules applied by the walkers before a path string is built
+struct FilterRules
+{
+    // Gitignore-style name globs ('*', '?', '[...]'); a trailing '/' restricts the
+    // pattern to directories and a leading '!' re-includes a previously excluded name
+    vector<wstring> excludePatterns;
+
+    // When non-empty, files must match at least one of these name globs
+    vector<wstring> includePatterns;
+
+    // When non-empty, only files with one of these extensions are indexed ("log" or ".log")
+    vector<wstring> extensions;
+
+    // Number of directory levels below the root to descend into (-1 for unlimited)
+    int maxDepth = -1;
+
+    // File size thresholds in bytes (0 for no limit)
+    unsigned long long minFileSize = 0;
+    unsigned long long maxFileSize = 0;
+
+    // Skip files and directories flagged hidden or system
+    bool skipHidden = false;
+
+    // Descend into reparse points (mount points, junctions) that may lead to other volumes
+    bool crossFilesystems = true;
+
+    // Descend into directory symbolic links; every directory is then identified by volume serial
+    // and file index so cycles and directories reachable by several paths are walked once
+    bool followLinks = false;
+
+    // Index a file with several hard links once, under the first path the walk reaches
+    bool dedupHardlinks = false;
+};
+
+// Open-addressing set of case-folded names, probed without building a wstring
+class CNameSet
+{
+public:
+    void insert(const wstring& name);
+    bool contains(const wchar_t* name, size_t length) const;
+    bool empty() const { return count == 0; }
+
+private:
+    static size_t hash(const wchar_t* name, size_t length);
+    void rehash(size_t capacity);
+
+    vector<wstring> slots;
+    size_t count = 0;
+};
+
+// Glob compiled once into a flat token program
+class CGlobPattern
+{
+public:
+    explicit CGlobPattern(const wstring& pattern);
+    bool match(const wchar_t* name, size_t length) const;
+
+private:
+    enum class TokenType { Literal, AnyChar, AnySequence, CharClass };
+
+    struct Token
+    {
+        TokenType type;
+        wchar_t literal;
+        bool negated;
+        vector<pair<wchar_t, wchar_t>> ranges;
+    };
+
+    bool matchToken(const Token& token, wchar_t c) const;
+
+    vector<Token> tokens;
+};
+
+// Filter compiled from FilterRules into hash sets and glob programs
+class CIndexFilter
+{
+public:
+    CIndexFilter() = default;
+    explicit CIndexFilter(const FilterRules& rules);
+
+    // Returns true if the walker should enumerate this subdirectory; depth is 1 for children of the root
+    bool bAcceptDirectory(const WIN32_FIND_DATA& findFileData, int depth) const;
+
+    // Returns true if this file should be added to the index
+    bool bAcceptFile(const WIN32_FIND_DATA& findFileData) const;
+
+    const FilterRules& Rules() const { return rules; }
+
+private:
+    // One compiled rule group: exact names, "*.ext" suffixes and general globs
+    struct RuleSet
+    {
+        CNameSet names;
+        CNameSet extensions;
+        vector<CGlobPattern> globs;
+
+        void add(const wstring& pattern);
+        bool match(const wchar_t* name, size_t length) const;
+        bool empty() const { return names.empty() && extensions.empty() && globs.empty(); }
+    };
+
+    bool bExcluded(const wchar_t* name, size_t length, bool isDirectory) const;
+
+    RuleSet excludeAny;
+    RuleSet excludeDirectories;
+    RuleSet reinclude;
+    RuleSet include;
+    CNameSet extensions;
+    FilterRules rules;
+};
+
+// Splits a ';'-separated list of patterns as typed at the prompt
+vector<wstring> vSplitPatterns(const wstring& list);
+
+#endif // INDEXFILTER_H
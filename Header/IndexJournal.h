@@ -0,0 +1,86 @@
+#pragma once
+#ifndef INDEXJOURNAL_H
+#define INDEXJOURNAL_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <functional>
+#include "LinkTracker.h"
+
+using namespace std;
+
+// One accepted file of a completed directory
+struct JournalEntry
+{
+    wstring name;
+    uint64_t size = 0;
+    uint64_t lastWriteTime = 0; // FILETIME in 100-nanosecond ticks
+    FileIdentity identity;      // Set when the link tracker opened the file
+};
+
+// A directory whose enumeration finished: its files and the subdirectories it queued, with the
+// identities the link tracker recorded for them so a resumed walk can seed its tracker
+struct JournalDirectory
+{
+    wstring path;
+    vector<JournalEntry> files;
+    vector<wstring> subdirectories;
+    vector<FileIdentity> subdirectoryIdentities;
+};
+
+// A directory a resumed walk still has to enumerate
+struct PendingDirectory
+{
+    wstring path;
+    int depth;
+};
+
+// Append-only journal of completed directories, so a killed indexing run resumes where it stopped.
+// Each record carries its length and a CRC-32 of its payload; recovery reads the file front to back
+// and cuts it at the first torn or corrupt record
+class CIndexJournal
+{
+public:
+    // Open the journal of a walk of root, creating it if missing; throws if it belongs to another root
+    CIndexJournal(const wstring& journalPath, const wstring& root);
+    ~CIndexJournal();
+
+    CIndexJournal(const CIndexJournal&) = delete;
+    CIndexJournal& operator=(const CIndexJournal&) = delete;
+
+    // Replay the intact records in the order they were written, parents before children, and return
+    // the directories listed but never completed (just the root for a new journal); call once before Append
+    vector<PendingDirectory> Recover(const function<void(const JournalDirectory&)>& replay);
+
+    // Record a completed directory; safe to call from several workers. Records reach the file at once
+    // and are forced to disk every syncInterval records
+    void Append(const JournalDirectory& directory);
+
+    // Delete the journal once the index it protects has been written
+    void Complete();
+
+    size_t RecoveredCount() const { return recovered; }
+    uint64_t TruncatedBytes() const { return truncated; }
+
+    // Records between forced writes to disk
+    void SetSyncInterval(unsigned records) { syncInterval = records; }
+
+    static uint32_t Crc32(const void* data, size_t length, uint32_t crc = 0);
+
+private:
+    wstring journalPath;
+    wstring root;
+    FILE* file = nullptr;
+    bool recoveredOnce = false;
+    size_t recovered = 0;
+    uint64_t truncated = 0;
+    unsigned syncInterval = 256;
+    unsigned unsynced = 0;
+    mutex journalMutex;
+};
+
+#endif // INDEXJOURNAL_H
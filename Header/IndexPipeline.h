@@ -0,0 +1,250 @@
+#pragma once
+#ifndef INDEXPIPELINE_H
+#define INDEXPIPELINE_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <concepts>
+#include <stdexcept>
+#include <stx/btree_map>
+#include "binarysearchtree.h"
+#include "IndexFilter.h"
+#include "LinkTracker.h"
+#include "NameKey.h"
+
+using namespace std;
+
+// Stand-in visitor used to state what a walker must accept
+struct WalkVisitorArchetype
+{
+    bool Directory(const WIN32_FIND_DATA& findFileData, int depth);
+    void File(const wstring& directory, const WIN32_FIND_DATA& findFileData);
+};
+
+// Walks a tree, asking the visitor before descending and handing it every file
+template <typename W>
+concept Walker = requires(W walker, const wstring& root, WalkVisitorArchetype& visitor)
+{
+    walker.Walk(root, visitor);
+};
+
+// Decides per directory entry whether it takes part in the index
+template <typename F>
+concept Filter = requires(const F filter, const WIN32_FIND_DATA& findFileData, int depth)
+{
+    { filter.AcceptDirectory(findFileData, depth) } -> convertible_to<bool>;
+    { filter.AcceptFile(findFileData) } -> convertible_to<bool>;
+};
+
+// Turns a file name into the key the sink is ordered or bucketed by
+template <typename K>
+concept KeyExtractor = requires(const K extractor, const wchar_t* name)
+{
+    typename K::KeyType;
+    { extractor.Key(name) } -> same_as<typename K::KeyType>;
+};
+
+// Stores (key, path) pairs
+template <typename S, typename Key>
+concept IndexSink = requires(S sink, Key key, wstring path)
+{
+    sink.Insert(move(key), move(path));
+};
+
+// Single-threaded depth-first walk using large-fetch enumeration; junctions are always checked for
+// cycles, and the rules' link options decide whether links are followed and hard links merged
+struct Win32Walker
+{
+    FilterRules linkRules;
+
+    template <typename Visitor>
+    void Walk(const wstring& root, Visitor& visitor)
+    {
+        CLinkTracker links(linkRules);
+        links.AddRoot(root);
+
+        WIN32_FIND_DATA findFileData;
+        vector<pair<wstring, int>> pending;
+        pending.push_back({ root, 0 });
+        bool isRoot = true;
+
+        while (!pending.empty())
+        {
+            wstring directory = move(pending.back().first);
+            int depth = pending.back().second;
+            pending.pop_back();
+
+            wstring searchPath = directory + L"\\*";
+            HANDLE hFind = FindFirstFileEx(searchPath.c_str(), FindExInfoBasic, &findFileData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+
+            if (hFind == INVALID_HANDLE_VALUE)
+            {
+                if (isRoot) throw runtime_error("Invalid handle value. Directory not found or access denied.");
+                continue;
+            }
+            isRoot = false;
+
+            do
+            {
+                // Ignore "." and ".." directories
+                if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    if (visitor.Directory(findFileData, depth + 1))
+                    {
+                        wstring subdirectory = directory + L"\\" + findFileData.cFileName;
+                        if (links.bEnterDirectory(subdirectory, findFileData)) pending.push_back({ move(subdirectory), depth + 1 });
+                    }
+                }
+                else
+                {
+                    // Hard links are only opened when the rules merge them
+                    uint64_t fileId;
+                    if (linkRules.dedupHardlinks && !links.bAcceptFile(directory + L"\\" + findFileData.cFileName, fileId)) continue;
+                    visitor.File(directory, findFileData);
+                }
+            } while (FindNextFile(hFind, &findFileData) != 0);
+
+            FindClose(hFind);
+        }
+    }
+};
+
+// Accepts everything; the checks compile away
+struct NoFilter
+{
+    constexpr bool AcceptDirectory(const WIN32_FIND_DATA&, int) const { return true; }
+    constexpr bool AcceptFile(const WIN32_FIND_DATA&) const { return true; }
+};
+
+// Applies compiled include/exclude rules
+struct RuleFilter
+{
+    const CIndexFilter& filter;
+
+    bool AcceptDirectory(const WIN32_FIND_DATA& findFileData, int depth) const { return filter.bAcceptDirectory(findFileData, depth); }
+    bool AcceptFile(const WIN32_FIND_DATA& findFileData) const { return filter.bAcceptFile(findFileData); }
+};
+
+// Polynomial rolling hash of the folded name, the same function CHashing::hash_filename calls
+struct PolynomialHashKey
+{
+    typedef size_t KeyType;
+
+    size_t Key(const wchar_t* name) const { return PolynomialNameHash(name, wcslen(name)); }
+};
+
+// Code point sum used by BtreeSearchIndexer, rendered as a string key
+struct CodePointSumKey
+{
+    typedef string KeyType;
+
+    string Key(const wchar_t* name) const
+    {
+        int hashCode = 0;
+        for (; *name != 0; name++) hashCode += static_cast<int>(*name);
+        return to_string(hashCode);
+    }
+};
+
+// For sinks ordered by the path itself
+struct NoKey
+{
+    struct KeyType {};
+
+    KeyType Key(const wchar_t*) const { return KeyType(); }
+};
+
+// Appends to a hash bucket map, like CHashing
+struct HashMapSink
+{
+    map<size_t, vector<wstring>>& index;
+
+    void Insert(size_t key, wstring&& path) { index[key].push_back(move(path)); }
+};
+
+// Stores one path per key in a B-tree, like BtreeSearchIndexer
+struct BtreeSink
+{
+    stx::btree_map<string, wstring>& index;
+
+    void Insert(string&& key, wstring&& path) { index[move(key)] = move(path); }
+};
+
+// Inserts paths into a binary search tree ordered by folded path
+struct BstSink
+{
+    BinarySearchTree<CFoldedKey>& tree;
+
+    void Insert(NoKey::KeyType, wstring&& path) { tree.insert(move(path)); }
+};
+
+// Walker x filter x key extractor x sink, resolved at compile time so the per-file path inlines
+template <Walker W, Filter F, KeyExtractor K, IndexSink<typename K::KeyType> S>
+class CIndexPipeline
+{
+public:
+    CIndexPipeline(W walker, F filter, K keyExtractor, S sink)
+        : walker(walker), filter(filter), keyExtractor(keyExtractor), sink(sink) {}
+
+    // Index the tree under root and return the number of files added
+    size_t Run(const wstring& root)
+    {
+        fileCount = 0;
+        walker.Walk(root, *this);
+        return fileCount;
+    }
+
+    // Walker callbacks
+    bool Directory(const WIN32_FIND_DATA& findFileData, int depth)
+    {
+        return filter.AcceptDirectory(findFileData, depth);
+    }
+
+    void File(const wstring& directory, const WIN32_FIND_DATA& findFileData)
+    {
+        if (!filter.AcceptFile(findFileData)) return;
+
+        sink.Insert(keyExtractor.Key(findFileData.cFileName), directory + L"\\" + findFileData.cFileName);
+        fileCount++;
+    }
+
+private:
+    W walker;
+    F filter;
+    K keyExtractor;
+    S sink;
+    size_t fileCount = 0;
+};
+
+// Indexing methods selectable at run time
+enum class IndexMethod { BinaryTree = 1, Btree = 2, Hashing = 3 };
+
+// Runtime facade: one switch per run, then a fully specialized pipeline
+class CIndexerFacade
+{
+public:
+    explicit CIndexerFacade(IndexMethod method, const CIndexFilter* filter = nullptr);
+
+    // Index the directory with the selected method and return the number of files
+    size_t IndexDirectory(const wstring& directory);
+
+    // Print the index the way the matching indexer does
+    void PrintIndex();
+
+private:
+    template <KeyExtractor K, typename S>
+    size_t Run(const wstring& directory, K keyExtractor, S sink);
+
+    IndexMethod method;
+    const CIndexFilter* filter;
+    BinarySearchTree<CFoldedKey> bst;
+    stx::btree_map<string, wstring> btreeIndex;
+    map<size_t, vector<wstring>> hashIndex;
+};
+
+#endif // INDEXPIPELINE_H
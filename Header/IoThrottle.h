@@ -0,0 +1,119 @@
+#pragma once
+#ifndef IOTHROTTLE_H
+#define IOTHROTTLE_H
+
+#define UNICODE
+#include <windows.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Scheduling class of the walker threads
+enum class IoPriority
+{
+    // Unchanged thread priority
+    Normal,
+
+    // Below-normal CPU priority; I/O keeps its normal priority
+    Low,
+
+    // Windows background mode: very low I/O and memory priority, yields to any foreground work
+    Idle
+};
+
+// Limits applied to directory enumeration so background indexing stays out of other workloads' way
+struct ThrottleConfig
+{
+    IoPriority priority = IoPriority::Normal;
+
+    // Directory reads started per second (0 for no limit)
+    double maxDirectoriesPerSecond = 0;
+
+    // Target mean latency of one enumeration call in microseconds; while exceeded the number of
+    // concurrent enumerations is cut, while met it grows back (0 disables adaptive concurrency)
+    unsigned latencyTargetMicroseconds = 0;
+};
+
+// Token-bucket rate limit and AIMD concurrency limit shared by the enumeration workers
+class CIoThrottle
+{
+public:
+    CIoThrottle(const ThrottleConfig& config, unsigned maxConcurrency);
+
+    // Current number of enumerations allowed to run at once
+    unsigned Concurrency() const;
+
+    // Runs the calling thread at the configured priority and restores it on release, so pooled
+    // threads and the caller leave background mode once their directory or batch is done
+    class CPriorityScope
+    {
+    public:
+        explicit CPriorityScope(const CIoThrottle& throttle);
+        ~CPriorityScope();
+
+        CPriorityScope(const CPriorityScope&) = delete;
+        CPriorityScope& operator=(const CPriorityScope&) = delete;
+
+    private:
+        // What this scope changed; a thread already in background mode is left for its owner to end
+        IoPriority applied = IoPriority::Normal;
+        int previousPriority = THREAD_PRIORITY_NORMAL;
+    };
+
+    // Holds one concurrency slot for the duration of a directory enumeration
+    class CSlot
+    {
+    public:
+        explicit CSlot(CIoThrottle& throttle);
+        ~CSlot();
+
+        CSlot(const CSlot&) = delete;
+        CSlot& operator=(const CSlot&) = delete;
+
+        // Run one FindFirstFile/FindNextFile call and add its own duration to the latency sample,
+        // so filtering and bookkeeping between calls do not count as I/O latency
+        template <typename Call>
+        auto Timed(Call call)
+        {
+            auto started = chrono::steady_clock::now();
+            auto result = call();
+            callTime += chrono::steady_clock::now() - started;
+            calls++;
+            return result;
+        }
+
+    private:
+        CIoThrottle& throttle;
+        CPriorityScope priority;
+        chrono::steady_clock::duration callTime{ 0 };
+        unsigned calls = 0;
+    };
+
+private:
+    // Enumerations completed between two concurrency adjustments
+    static const unsigned WINDOW = 16;
+
+    void Acquire();
+    void Release(chrono::nanoseconds callTime, unsigned calls);
+
+    ThrottleConfig config;
+    unsigned maxConcurrency;
+
+    mutable mutex throttleMutex;
+    condition_variable slotFree;
+
+    // Token bucket
+    double tokens;
+    double burst;
+    chrono::steady_clock::time_point refilled;
+
+    // Concurrency limit and the latency window that drives it
+    unsigned limit;
+    unsigned active = 0;
+    unsigned windowSamples = 0;
+    double windowLatency = 0;
+};
+
+#endif // IOTHROTTLE_H
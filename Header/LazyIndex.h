@@ -0,0 +1,81 @@
+#pragma once
+#ifndef LAZYINDEX_H
+#define LAZYINDEX_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "IndexFilter.h"
+
+using namespace std;
+
+// Directory index that is materialized on demand: a directory is an unexpanded placeholder
+// until a lookup or traversal reaches it, its listing is then cached, and the cached listing
+// is re-read whenever the directory's last-write time has changed
+class CLazyIndex
+{
+public:
+    explicit CLazyIndex(const wstring& root, const CIndexFilter* filter = nullptr);
+
+    // Files and subdirectory names directly in a directory (relative to the root or absolute);
+    // returns false if the directory is not in the tree
+    bool List(const wstring& directory, vector<wstring>& files, vector<wstring>& subdirectories);
+
+    // Visit every file path in the subtree, expanding each directory as the traversal reaches it;
+    // a directory reached again through a junction or followed link is visited once
+    void ForEachFile(const wstring& directory, const function<void(const wstring& path)>& visit);
+
+    // Paths of files with this name (case-insensitive) in the subtree
+    vector<wstring> Find(const wstring& directory, const wstring& name);
+
+    // Directories read so far and directories known only as placeholders
+    size_t ExpandedCount() const;
+    size_t PlaceholderCount() const;
+
+    // Directory reads performed, counting re-reads after a change
+    size_t Expansions() const { return expansions; }
+
+    const wstring& Root() const { return root; }
+
+private:
+    // One directory's contents as of lastWriteTime; never modified once published
+    struct Listing
+    {
+        FILETIME lastWriteTime;
+        vector<wstring> files;
+        vector<wstring> subdirectories;
+
+        // Attributes of each subdirectory, so traversals can tell junctions and links apart
+        vector<DWORD> subdirectoryAttributes;
+    };
+
+    // Cached listing of a directory, re-read if it is missing or stale (nullptr if the directory is gone)
+    shared_ptr<const Listing> Expand(const wstring& path, int depth);
+
+    // Drop a directory and every cached listing below it; the caller holds listingsMutex exclusively
+    void EraseSubtree(const wstring& key);
+
+    // Full path and depth of a directory, expanding only the directories along the way
+    bool Resolve(const wstring& directory, wstring& path, int& depth);
+
+    // Folded path (see FoldName) with '\\' separators and no trailing separator
+    static wstring Key(const wstring& path);
+
+    wstring root;
+    const CIndexFilter* filter;
+
+    // Listings by folded path; a null listing is a placeholder seen in its parent but not yet read
+    mutable shared_mutex listingsMutex;
+    unordered_map<wstring, shared_ptr<const Listing>> listings;
+    atomic<size_t> expansions{ 0 };
+};
+
+#endif // LAZYINDEX_H
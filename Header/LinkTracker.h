@@ -0,0 +1,91 @@
+#pragma once
+#ifndef LINKTRACKER_H
+#define LINKTRACKER_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <mutex>
+#include <unordered_set>
+#include <cstdint>
+#include "IndexFilter.h"
+
+using namespace std;
+
+// Identity of a file or directory independent of the path it was reached by; all zero when the
+// walk did not open it
+struct FileIdentity
+{
+    DWORD volumeSerial = 0;
+    ULONGLONG fileIndex = 0;
+
+    bool bKnown() const { return volumeSerial != 0 || fileIndex != 0; }
+
+    bool operator==(const FileIdentity& other) const { return volumeSerial == other.volumeSerial && fileIndex == other.fileIndex; }
+};
+
+// Concurrent set of identities; lock striping keeps workers on different stripes from contending
+class CIdentitySet
+{
+public:
+    // Returns true if the identity was not in the set yet
+    bool Insert(const FileIdentity& identity);
+
+    size_t size() const;
+
+private:
+    struct Hasher
+    {
+        size_t operator()(const FileIdentity& identity) const;
+    };
+
+    // Each stripe on its own cache line
+    struct alignas(64) Stripe
+    {
+        mutable mutex stripeMutex;
+        unordered_set<FileIdentity, Hasher> identities;
+    };
+
+    static const size_t STRIPES = 64;
+    Stripe stripes[STRIPES];
+};
+
+// Per-walk state for following directory links without looping and for indexing hard-linked files once
+class CLinkTracker
+{
+public:
+    explicit CLinkTracker(const FilterRules& rules);
+
+    // Record the walk's root so links back to it are recognized
+    void AddRoot(const wstring& path);
+
+    // Returns false for a directory that has already been walked under another path (or cannot be
+    // opened); when links are not followed only reparse points are opened, other directories are entered
+    bool bEnterDirectory(const wstring& path, const WIN32_FIND_DATA& findFileData) { return bEnterDirectory(path, findFileData.dwFileAttributes); }
+    bool bEnterDirectory(const wstring& path, DWORD attributes);
+
+    // As above; identity receives the directory's identity when it was opened, zero otherwise
+    bool bEnterDirectory(const wstring& path, DWORD attributes, FileIdentity& identity);
+
+    // Returns false for another hard link to a file already accepted; fileId receives the file
+    // index when the file was opened, 0 otherwise
+    bool bAcceptFile(const wstring& path, uint64_t& fileId);
+
+    // As above, with the whole identity
+    bool bAcceptFile(const wstring& path, FileIdentity& identity);
+
+    // Record a directory or file a resumed walk already indexed, by the identity its walk recorded
+    void AddDirectory(const FileIdentity& identity) { if (identity.bKnown()) directories.Insert(identity); }
+    void AddFile(const FileIdentity& identity) { if (identity.bKnown()) files.Insert(identity); }
+
+    // Open the file or directory (following links) and read its identity and link count
+    static bool bQueryIdentity(const wstring& path, FileIdentity& identity, DWORD& links);
+
+private:
+    bool followLinks;
+    bool dedupHardlinks;
+    CIdentitySet directories;
+    CIdentitySet files;
+};
+
+#endif // LINKTRACKER_H
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef NAMEKEY_H
+#define NAMEKEY_H
+
+#define UNICODE
+#include <string>
+#include <ostream>
+
+using namespace std;
+
+// Case-folded, composed form of a name: a letter followed by combining marks is composed into its
+// precomposed letter (so NFD names copied from macOS match NFC ones) and letters are lower-cased.
+// Pure-ASCII names only lower-case A-Z; other characters go through sorted lookup tables
+wstring FoldName(const wchar_t* name, size_t length);
+
+inline wstring FoldName(const wstring& name) { return FoldName(name.data(), name.size()); }
+
+// Polynomial rolling hash of the folded name, below 1e9 + 9; the key CHashing::hash_filename and the
+// pipeline's PolynomialHashKey both use, so their indexes agree
+size_t PolynomialNameHash(const wchar_t* name, size_t length);
+
+// Name or path stored with its folded form, computed once on insertion; ordering and equality
+// use the folded form so case and normalization variants land on the same key
+class CFoldedKey
+{
+public:
+    CFoldedKey() = default;
+    CFoldedKey(wstring text) : text(move(text)), folded(FoldName(this->text)) {}
+
+    const wstring& Text() const { return text; }
+    const wstring& Folded() const { return folded; }
+
+    bool operator<(const CFoldedKey& other) const { return folded < other.folded; }
+    bool operator==(const CFoldedKey& other) const { return folded == other.folded; }
+
+private:
+    wstring text;
+    wstring folded;
+};
+
+// Keys print as the name was found on disk
+inline wostream& operator<<(wostream& out, const CFoldedKey& key) { return out << key.Text(); }
+
+#endif // NAMEKEY_H
@@ -0,0 +1,170 @@
+#pragma once
+#ifndef QUERYBENCH_H
+#define QUERYBENCH_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "IndexFilter.h"
+#include "FlatHashIndex.h"
+#include "SecondaryIndex.h"
+#include "binarysearchtree.h"
+#include "NameKey.h"
+
+using namespace std;
+
+// Kinds of lookups in a query mix; matching is case-insensitive on file names
+enum class QueryKind { Exact, Prefix, Substring, Extension, Negative };
+
+struct BenchQuery
+{
+    QueryKind kind;
+    wstring text;
+};
+
+// Relative weights of the query kinds in a synthetic mix
+struct QueryMix
+{
+    unsigned exact = 40;
+    unsigned prefix = 20;
+    unsigned substring = 15;
+    unsigned extension = 15;
+    unsigned negative = 10;
+};
+
+struct BenchConfig
+{
+    // Queries per run; recorded query lists are replayed cyclically up to this count
+    size_t queryCount = 10000;
+
+    // Threads issuing queries concurrently
+    unsigned threads = 1;
+
+    QueryMix mix;
+    unsigned seed = 1;
+};
+
+// Measurements of one backend under one query list
+struct BenchResult
+{
+    string backend;
+    size_t queries = 0;
+    size_t matches = 0;
+    double seconds = 0;
+    double queriesPerSecond = 0;
+
+    // Latency percentiles in microseconds
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+
+    // Growth of the process's private bytes while the backend was built
+    size_t memoryBytes = 0;
+};
+
+// One index implementation under test; Run must be safe to call from several threads at once
+class CQueryBackend
+{
+public:
+    virtual ~CQueryBackend() = default;
+    virtual const char* Name() const = 0;
+    virtual void Build(const vector<wstring>& paths) = 0;
+
+    // Returns the number of matching files
+    virtual size_t Run(const BenchQuery& query) const = 0;
+};
+
+// Flat hash index: exact and negative lookups probe a bucket, everything else scans the name pool
+class CHashQueryBackend : public CQueryBackend
+{
+public:
+    const char* Name() const override { return "hash"; }
+    void Build(const vector<wstring>& paths) override;
+    size_t Run(const BenchQuery& query) const override;
+
+private:
+    CFlatHashIndex index;
+};
+
+// B-tree secondary indexes: name prefixes and reversed names are range scans
+class CBtreeQueryBackend : public CQueryBackend
+{
+public:
+    const char* Name() const override { return "btree"; }
+    void Build(const vector<wstring>& paths) override;
+    size_t Run(const BenchQuery& query) const override;
+
+private:
+    CSecondaryIndex index;
+};
+
+// Unbalanced binary search tree of names, inserted in shuffled order so it does not degenerate
+class CBstQueryBackend : public CQueryBackend
+{
+public:
+    // Walk order is the shape the BST indexer builds; shuffled is the balanced best case
+    explicit CBstQueryBackend(bool shuffled) : shuffled(shuffled) {}
+    const char* Name() const override { return shuffled ? "bst-shuffled" : "bst-walk"; }
+    void Build(const vector<wstring>& paths) override;
+    size_t Run(const BenchQuery& query) const override;
+
+private:
+    // Count matching names in [low, high), skipping subtrees outside the range (nullptr for unbounded)
+    size_t CountMatches(const BenchQuery& query, const wstring* low, const wstring* high) const;
+
+    bool shuffled;
+    BinarySearchTree<CFoldedKey> tree;
+};
+
+// No index: every query walks the directory tree, as the search mode does
+class CScanQueryBackend : public CQueryBackend
+{
+public:
+    CScanQueryBackend(const wstring& root, const CIndexFilter* filter) : root(root), filter(filter) {}
+    const char* Name() const override { return "search"; }
+    void Build(const vector<wstring>&) override {}
+    size_t Run(const BenchQuery& query) const override;
+
+private:
+    wstring root;
+    const CIndexFilter* filter;
+};
+
+// Load tester that replays one query list against several backends built from the same tree
+class CQueryBench
+{
+public:
+    explicit CQueryBench(const BenchConfig& config) : config(config) {}
+
+    // Walk the tree once; returns the number of files found
+    size_t LoadTree(const wstring& root, const CIndexFilter* filter);
+
+    // Draw the configured mix from the loaded names
+    void SynthesizeQueries();
+
+    // Read recorded queries, one "kind<TAB>text" per line with kind exact, prefix, substring, ext or negative
+    void LoadQueries(const wstring& path);
+
+    // Build the backend, then time every query from the configured number of threads
+    BenchResult Run(CQueryBackend& backend);
+
+    static void PrintResults(const vector<BenchResult>& results);
+
+    // Private bytes of this process
+    static size_t PrivateBytes();
+
+    // Case-folded name a query is matched against
+    static wstring Fold(const wstring& text);
+
+    // Returns true if the folded name matches the query
+    static bool bMatches(const BenchQuery& query, const wchar_t* name, size_t length);
+
+private:
+    BenchConfig config;
+    vector<wstring> paths;
+    vector<BenchQuery> queries;
+};
+
+#endif // QUERYBENCH_H
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef SECONDARYINDEX_H
+#define SECONDARYINDEX_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stx/btree_multimap>
+
+using namespace std;
+
+// Secondary indexes over indexed file paths, stored in B-trees so prefix queries are range scans
+class CSecondaryIndex
+{
+public:
+    typedef stx::btree_multimap<wstring, uint32_t> KeyIndex;
+
+    // Half-open range of matching entries; iterating it performs no allocation
+    class CRange
+    {
+    public:
+        CRange(KeyIndex::const_iterator first, KeyIndex::const_iterator last) : first(first), last(last) {}
+
+        KeyIndex::const_iterator begin() const { return first; }
+        KeyIndex::const_iterator end() const { return last; }
+        bool empty() const { return first == last; }
+
+    private:
+        KeyIndex::const_iterator first;
+        KeyIndex::const_iterator last;
+    };
+
+    // Add a file by its full path and file name; callers serialize concurrent adds
+    void Add(const wstring& filePath, const wstring& fileName);
+
+    // All files below the directory, e.g. FilesUnder(L"C:\\srv\\x")
+    CRange FilesUnder(const wstring& directory) const;
+
+    // All files with the extension, e.g. FilesWithExtension(L"log") or FilesWithExtension(L".log")
+    CRange FilesWithExtension(const wstring& extension) const;
+
+    // All files whose name starts with the prefix, e.g. NamesStartingWith(L"report_")
+    CRange NamesStartingWith(const wstring& prefix) const;
+
+    // Full path of the file an entry of a range refers to
+    const wstring& Path(uint32_t fileId) const { return paths[fileId]; }
+    const wstring& Path(const KeyIndex::value_type& entry) const { return paths[entry.second]; }
+
+    size_t size() const { return paths.size(); }
+
+    // Folded path (see FoldName) with '/' turned into '\' and duplicate or trailing separators removed
+    static wstring NormalizePath(const wstring& path);
+
+private:
+    static CRange PrefixRange(const KeyIndex& index, const wstring& prefix);
+
+    vector<wstring> paths;
+    KeyIndex byPath;
+    KeyIndex byName;
+    KeyIndex byReversedName;
+};
+
+#endif // SECONDARYINDEX_H
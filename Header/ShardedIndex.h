@@ -0,0 +1,103 @@
+#pragma once
+#ifndef SHARDEDINDEX_H
+#define SHARDEDINDEX_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include "IndexFile.h"
+#include "IndexFilter.h"
+
+using namespace std;
+
+// One root (volume, mount or directory) and how to index it
+struct ShardConfig
+{
+    wstring root;
+
+    // Persisted index for this shard; empty to keep it in memory only
+    wstring indexPath;
+
+    // Enumeration workers for this shard alone (0 for one per logical processor)
+    unsigned workers = 0;
+
+    // Include/exclude rules (nullptr indexes everything)
+    const CIndexFilter* filter = nullptr;
+};
+
+// Lifecycle of a shard's current build
+enum class ShardState { Empty, Building, Ready, Failed };
+
+// Index over many roots, each built, persisted and rebuilt independently as its own shard.
+// Shards are managed (added, rebuilt, waited for) from one thread; queries may come from any thread
+class CShardedIndex
+{
+public:
+    ~CShardedIndex();
+
+    // Register a root and return its shard number
+    size_t AddShard(const ShardConfig& config);
+
+    // Start building every shard on its own thread; returns immediately
+    void BuildAll();
+
+    // Start rebuilding one shard; queries keep using its previous snapshot until the build finishes.
+    // Returns false if the shard is already building
+    bool Rebuild(size_t shard);
+
+    // Replace a shard's snapshot with its persisted index
+    bool Load(size_t shard);
+
+    void Wait(size_t shard);
+    void WaitAll();
+
+    // Called on the builder's thread as each shard finishes (Ready or Failed), in completion order.
+    // Set before BuildAll; the callback must be safe to run concurrently with queries and other callbacks
+    void SetCompletionCallback(function<void(size_t shard, ShardState state)> callback) { onCompleted = move(callback); }
+
+    ShardState State(size_t shard) const;
+    size_t ShardCount() const { return shards.size(); }
+    const wstring& Root(size_t shard) const { return shards[shard]->config.root; }
+
+    // Query every shard with a snapshot in parallel and k-way merge the path-sorted results;
+    // at most limit results are returned (0 for all)
+    vector<IndexRecord> Query(const function<bool(const IndexRecord&)>& predicate, size_t limit = 0) const;
+
+    // Files whose name contains the text, compared on folded names (case- and normalization-insensitive)
+    vector<IndexRecord> FindByName(const wstring& text, size_t limit = 0) const;
+
+private:
+    // Immutable records of one build, with each file name folded once so name queries only compare
+    struct Snapshot
+    {
+        vector<IndexRecord> records;
+        vector<wstring> foldedNames;
+    };
+
+    struct Shard
+    {
+        ShardConfig config;
+        ShardState state = ShardState::Empty;
+        shared_ptr<const Snapshot> snapshot; // Swapped atomically under shardMutex once a build completes
+        thread builder;
+        mutable mutex shardMutex;
+    };
+
+    static shared_ptr<const Snapshot> BuildSnapshot(const ShardConfig& config);
+    static void vFoldNames(Snapshot& snapshot);
+
+    shared_ptr<const Snapshot> CurrentSnapshot(size_t shard) const;
+
+    // Scatter a predicate over record positions of every snapshot and merge the matches in path order
+    vector<IndexRecord> Scatter(const function<bool(const Snapshot&, size_t)>& predicate, size_t limit) const;
+
+    vector<unique_ptr<Shard>> shards;
+    function<void(size_t, ShardState)> onCompleted;
+};
+
+#endif // SHARDEDINDEX_H
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef SPILLINGINDEX_H
+#define SPILLINGINDEX_H
+
+#define UNICODE
+#include <string>
+#include <vector>
+#include <mutex>
+#include "IndexFile.h"
+
+using namespace std;
+
+// Collects index records under a memory budget, spilling sorted runs to temporary
+// files when the budget is exceeded and merging them into a persisted index at the end
+class CSpillingIndexBuilder
+{
+public:
+    // memoryBudget is in bytes; tempDirectory defaults to the system temporary directory
+    explicit CSpillingIndexBuilder(size_t memoryBudget, const wstring& tempDirectory = L"");
+    ~CSpillingIndexBuilder();
+
+    // Thread-safe; may write a sorted run to disk before returning
+    void Add(IndexRecord&& record);
+
+    // Merge the in-memory records and every spilled run into outputPath, sorted by path
+    void Finish(const wstring& outputPath);
+
+    size_t RunCount() const { return runFiles.size(); }
+    size_t MemoryUsed() const { return bufferBytes + buffer.capacity() * sizeof(IndexRecord); }
+
+private:
+    // Upper bound on runs merged at once, keeping open file handles bounded
+    static const size_t MAX_MERGE_FAN_IN = 64;
+
+    static size_t RecordBytes(const IndexRecord& record);
+
+    void FlushRun();
+    wstring NewTempFile();
+    void MergeRuns(const vector<wstring>& inputs, vector<IndexRecord>* memoryRun, const wstring& outputPath);
+    void RemoveRuns();
+
+    size_t memoryBudget;
+    wstring tempDirectory;
+    vector<IndexRecord> buffer;
+    size_t bufferBytes = 0;
+    vector<wstring> runFiles;
+    mutex builderMutex;
+};
+
+#endif // SPILLINGINDEX_H
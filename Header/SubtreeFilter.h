@@ -0,0 +1,114 @@
+#pragma once
+#ifndef SUBTREEFILTER_H
+#define SUBTREEFILTER_H
+
+#define UNICODE
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <mutex>
+#include "IndexFilter.h"
+#include "LinkTracker.h"
+
+using namespace std;
+
+// Xor filter with 8-bit fingerprints: about 9.8 bits per key, no false negatives,
+// roughly 0.4% false positives
+class CXorFilter
+{
+public:
+    // Build from 64-bit key hashes; duplicates are allowed
+    void Build(vector<uint64_t> keys);
+
+    bool Contains(uint64_t key) const;
+
+    size_t SizeInBytes() const { return fingerprints.size(); }
+
+    void Save(FILE* file) const;
+
+    // Fails rather than allocating when the stored size exceeds the bytes left before fileSize
+    bool Load(FILE* file, uint64_t fileSize);
+
+private:
+    static uint64_t Mix(uint64_t key);
+    static uint32_t Reduce(uint32_t hash, uint32_t range) { return static_cast<uint32_t>((uint64_t(hash) * range) >> 32); }
+    void Slots(uint64_t hash, uint32_t slots[3]) const;
+
+    uint64_t seed = 0;
+    uint32_t blockLength = 0;
+    vector<uint8_t> fingerprints;
+};
+
+// Directory tree where every node carries an xor filter of the file names in its subtree,
+// so "is there a file named X under Y" skips subtrees that cannot contain X
+class CSubtreeFilterIndex
+{
+public:
+    // Walk the tree under root and build the filters bottom-up
+    void Build(const wstring& root, const CIndexFilter* filter = nullptr);
+
+    // True if a file with this name (case-insensitive) exists under the directory
+    bool Exists(const wstring& fileName, const wstring& underDirectory) const;
+
+    // Every directory under the given one that directly contains a file with this name
+    vector<wstring> Find(const wstring& fileName, const wstring& underDirectory) const;
+
+    // Directory the tree was built from
+    const wstring& RootPath() const { return nodes.empty() ? emptyPath : nodes[0].path; }
+
+    // True if the directory is part of the indexed tree
+    bool bContains(const wstring& directory) const { return Locate(directory) >= 0; }
+
+    // Number of subtrees skipped by the filters during the last query
+    size_t PrunedSubtrees() const { return prunedSubtrees; }
+
+    // Persist the tree and filters, a small fraction of the full index
+    void Save(const wstring& filePath) const;
+    bool Load(const wstring& filePath);
+
+    // Hash of the case-folded name, the key stored in the filters
+    static uint64_t HashName(const wchar_t* name);
+
+private:
+    struct Node
+    {
+        wstring path;
+        vector<uint32_t> children;
+        vector<uint64_t> fileHashes; // Sorted hashes of the files directly in this directory
+        CXorFilter subtree;
+    };
+
+    friend class CSubtreeFilterBuilder;
+
+    void Collect(uint32_t nodeId, uint64_t hash, bool stopAtFirst, vector<wstring>& found) const;
+    int Locate(const wstring& directory) const;
+
+    vector<Node> nodes;
+    unordered_map<wstring, uint32_t> nodeByPath;
+    mutable size_t prunedSubtrees = 0;
+    wstring emptyPath;
+};
+
+// Collects each directory's file names as an indexing walk completes it, so the filters are built
+// bottom-up from the walk's own listings instead of a second walk; safe to call from several workers
+class CSubtreeFilterBuilder
+{
+public:
+    explicit CSubtreeFilterBuilder(const wstring& root) : root(root) {}
+
+    // Record a directory the walk entered with the hashes (see HashName) of its accepted files
+    void AddDirectory(const wstring& path, vector<uint64_t> fileHashes);
+
+    // Link every directory to its parent and build each subtree's filter from its children's
+    void Finish(CSubtreeFilterIndex& index);
+
+private:
+    wstring root;
+    mutex builderMutex;
+    unordered_map<wstring, vector<uint64_t>> directories;
+};
+
+#endif // SUBTREEFILTER_H
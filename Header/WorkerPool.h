@@ -0,0 +1,106 @@
+#pragma once
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#define UNICODE
+#include <windows.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <atomic>
+
+using namespace std;
+
+// Thread placement and concurrency settings for the indexers
+struct PoolConfig
+{
+    // Hashing/insertion workers (0 for one per logical processor)
+    unsigned cpuWorkers = 0;
+
+    // Directory enumeration workers, sized separately because they mostly wait on the file system
+    unsigned ioWorkers = 0;
+
+    // Pin each CPU worker to one logical processor
+    bool pinToCores = true;
+
+    // Spread workers over NUMA nodes and keep their work and index shards node-local
+    bool numaAware = true;
+};
+
+// How a pool binds its threads to processors
+enum class PinMode { None, Node, Core };
+
+// Fixed-size thread pool with one task queue per NUMA node; each queue has its own lock, and a
+// worker takes another node's lock only to steal when its own queue is empty
+class CWorkerPool
+{
+public:
+    CWorkerPool(unsigned threadCount, PinMode pinMode, bool numaAware);
+    ~CWorkerPool();
+
+    CWorkerPool(const CWorkerPool&) = delete;
+    CWorkerPool& operator=(const CWorkerPool&) = delete;
+
+    // Queue a task on the given node (or on the caller's node when called from a worker)
+    void Submit(unsigned node, function<void()> task);
+    void Submit(function<void()> task) { Submit(CurrentNode(), move(task)); }
+
+    // Block until every submitted task, including tasks submitted by tasks, has finished;
+    // rethrows the first exception a task raised
+    void WaitIdle();
+
+    unsigned NodeCount() const { return static_cast<unsigned>(queues.size()); }
+    unsigned WorkerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    // NUMA node of the calling worker thread (0 outside a pool)
+    static unsigned CurrentNode();
+
+private:
+    // One logical processor as Windows addresses it
+    struct ProcessorSlot
+    {
+        WORD group;
+        BYTE number;
+    };
+
+    // Task queue of one node, padded so neighbouring nodes' locks do not share a cache line
+    struct alignas(64) NodeQueue
+    {
+        mutex queueMutex;
+        condition_variable workAvailable;
+        deque<function<void()>> tasks;
+
+        // Workers of this node blocked on workAvailable
+        atomic<unsigned> sleepers{ 0 };
+    };
+
+    // Processors per NUMA node; a single entry when NUMA placement is off
+    static vector<vector<ProcessorSlot>> DiscoverTopology(bool numaAware);
+
+    // Processors of a node, one GROUP_AFFINITY per processor group it spans
+    static vector<GROUP_AFFINITY> NodeAffinities(USHORT node);
+
+    void WorkerLoop(unsigned node);
+    bool PopTask(unsigned node, function<void()>& task);
+    void Wake(unsigned node);
+
+    vector<unique_ptr<NodeQueue>> queues;
+    vector<thread> workers;
+
+    // Tasks sitting in any queue, and tasks submitted but not yet finished
+    atomic<size_t> queued{ 0 };
+    atomic<size_t> pending{ 0 };
+    atomic<bool> stopping{ false };
+
+    // Guards firstError and backs the idle wait
+    mutex idleMutex;
+    condition_variable idle;
+    exception_ptr firstError;
+};
+
+#endif // WORKERPOOL_H
@@ -5,6 +5,12 @@
 #include <string>
 #include <Windows.h>
 #include <iostream>
+#include <vector>
+#include "IndexFilter.h"
+#include "LinkTracker.h"
+#include "SubtreeFilter.h"
+#include "SpillingIndex.h"
+#include "NameKey.h"
 using namespace std;
 
 template <typename T>
@@ -15,40 +21,49 @@ public:
     virtual void insert(T data) = 0;
 };
 
+// Plain node without a vtable; the tree drives insertion and traversal iteratively
 template <typename T>
-class CNode : public CAbstract<T>
+class CNode
 {
 public:
     T data;
     CNode<T>* left;
     CNode<T>* right;
 
-    CNode(T data) : data(data), left(nullptr), right(nullptr) {}
+    CNode(T data) : data(move(data)), left(nullptr), right(nullptr) {}
 
-    void traverse() override
+    // In-order traversal with an explicit stack
+    void traverse()
     {
-        if (left != nullptr)
-            left->traverse();
-        wcout << data << endl;
-        if (right != nullptr)
-            right->traverse();
+        vector<CNode<T>*> stack;
+        CNode<T>* node = this;
+        while (node != nullptr || !stack.empty())
+        {
+            while (node != nullptr)
+            {
+                stack.push_back(node);
+                node = node->left;
+            }
+            node = stack.back();
+            stack.pop_back();
+            wcout << node->data << endl;
+            node = node->right;
+        }
     }
 
-    void insert(T newData) override
+    // Walk down to the insertion point instead of recursing
+    void insert(T newData)
     {
-        if (newData < data)
-        {
-            if (left == nullptr)
-                left = new CNode(newData);
-            else
-                left->insert(newData);
-        }
-        else
+        CNode<T>* node = this;
+        while (true)
         {
-            if (right == nullptr)
-                right = new CNode(newData);
-            else
-                right->insert(newData);
+            CNode<T>*& child = (newData < node->data) ? node->left : node->right;
+            if (child == nullptr)
+            {
+                child = new CNode(move(newData));
+                return;
+            }
+            node = child;
         }
     }
 };
@@ -61,21 +76,24 @@ public:
 
     BinarySearchTree() : root(nullptr) {}
 
-    void traverse() override
+    void traverse() override final
     {
         if (root != nullptr)
             root->traverse();
     }
 
-    void insert(T newData) override
+    void insert(T newData) override final
     {
         if (root == nullptr)
-            root = new CNode<T>(newData);
+            root = new CNode<T>(move(newData));
         else
-            root->insert(newData);
+            root->insert(move(newData));
     }
 };
 
-void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearchTree<wstring>& bst);
+// Paths are keyed by their folded form, so the tree orders and matches them case-insensitively;
+// the outermost call creates the walk's link tracker and passes it down
+void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearchTree<CFoldedKey>& bst, const CIndexFilter* filter = nullptr, int depth = 0, CSpillingIndexBuilder* spillBuilder = nullptr,
+    CSubtreeFilterBuilder* filterBuilder = nullptr, CLinkTracker* links = nullptr);
 
 #endif // BINARYSEARCHTREE_H
@@ -15,6 +15,19 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include "IndexFilter.h"
+#include "FlatHashIndex.h"
+#include "SpillingIndex.h"
+#include "WorkerPool.h"
+#include "IoThrottle.h"
+#include "LinkTracker.h"
+#include "IndexJournal.h"
+#include "SubtreeFilter.h"
+#include "NameKey.h"
+#include <unordered_map>
 
 using namespace std;
 
@@ -46,6 +59,44 @@ public:
 
     // Function to print the indexed files
     void print_index(const map<size_t, vector<T>>& index, int file_count) override;
+
+    // List and hash files into a flat array index; far less memory than the map for large trees.
+    // Returns false if the walk failed
+    bool vListFilesInDirectoryH(const T& directory, CFlatHashIndex& index, int& file_count);
+
+    // Print the flat index in key order
+    void print_index(const CFlatHashIndex& index, int file_count);
+
+    // Set the include/exclude rules applied while walking (nullptr indexes everything)
+    void SetFilter(const CIndexFilter* indexFilter) { filter = indexFilter; }
+
+    // Send records to a memory-budgeted builder instead of the in-memory index (nullptr to disable)
+    void SetSpillBuilder(CSpillingIndexBuilder* builder) { spillBuilder = builder; }
+
+    // Set worker counts and thread placement for the enumeration and hashing pools
+    void SetPoolConfig(const PoolConfig& config) { poolConfig = config; }
+
+    // Set the priority, read rate limit and latency target of the enumeration workers
+    void SetThrottle(const ThrottleConfig& config) { throttleConfig = config; }
+
+    // Checkpoint completed directories to a journal and resume from it (nullptr to disable); the
+    // caller completes the journal once the index has been written
+    void SetJournal(CIndexJournal* indexJournal) { journal = indexJournal; }
+
+    // Hand each listed directory's file names to a subtree filter builder (nullptr to disable)
+    void SetFilterBuilder(CSubtreeFilterBuilder* builder) { filterBuilder = builder; }
+
+private:
+    // Walk the tree on the I/O and CPU pools, handing directories and hashed files to the sink
+    template <typename Sink>
+    void vWalk(const T& directory, Sink& sink, int& file_count);
+
+    const CIndexFilter* filter = nullptr;
+    CSpillingIndexBuilder* spillBuilder = nullptr;
+    PoolConfig poolConfig;
+    ThrottleConfig throttleConfig;
+    CIndexJournal* journal = nullptr;
+    CSubtreeFilterBuilder* filterBuilder = nullptr;
 };
 
 #endif // HASHING_H
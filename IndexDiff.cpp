@@ -0,0 +1,169 @@
+#include "IndexDiff.h"
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <string_view>
+
+CMemoryRecordSource::CMemoryRecordSource(vector<IndexRecord> records) : records(move(records))
+{
+    sort(this->records.begin(), this->records.end());
+}
+
+bool CMemoryRecordSource::Read(IndexRecord& record)
+{
+    if (position == records.size()) return false;
+    record = records[position++];
+    return true;
+}
+
+// Identity a move is recognised by, computed once per record: the file id on the first pass,
+// (name, size, timestamp) on the second. The views point into the records, which stay in place
+// until their key has been consumed
+struct MoveKey
+{
+    uint64_t fileId;
+    wstring_view name;
+    uint64_t size;
+    uint64_t lastWriteTime;
+
+    // Breaks ties so files with the same identity pair up in parent path order rather than arbitrarily
+    wstring_view parent;
+    size_t record;
+    bool eligible;
+
+    auto Identity() const { return tie(fileId, name, size, lastWriteTime); }
+    bool operator<(const MoveKey& other) const { return tie(fileId, name, size, lastWriteTime, parent) < tie(other.fileId, other.name, other.size, other.lastWriteTime, other.parent); }
+};
+
+// Keys of the records for one matching pass, sorted
+static vector<MoveKey> vMoveKeys(const vector<IndexRecord>& records, int pass)
+{
+    vector<MoveKey> keys;
+    keys.reserve(records.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const IndexRecord& record = records[i];
+        wstring_view path(record.path);
+        size_t separator = path.find_last_of(L"\\/");
+        wstring_view parent = (separator == wstring_view::npos) ? wstring_view() : path.substr(0, separator);
+        wstring_view name = (separator == wstring_view::npos) ? path : path.substr(separator + 1);
+
+        if (pass == 0) keys.push_back({ record.fileId, wstring_view(), 0, 0, parent, i, record.fileId != 0 });
+        else keys.push_back({ 0, name, record.size, record.lastWriteTime, parent, i, true });
+    }
+    sort(keys.begin(), keys.end());
+    return keys;
+}
+
+template <typename OlderSource, typename NewerSource>
+size_t CIndexDiff<OlderSource, NewerSource>::Compare(OlderSource& older, NewerSource& newer, const function<void(const DiffEntry&)>& report)
+{
+    size_t differences = 0;
+    vector<IndexRecord> removed;
+    vector<IndexRecord> added;
+
+    IndexRecord before, after;
+    bool hasBefore = older.Read(before);
+    bool hasAfter = newer.Read(after);
+    wstring previousBefore, previousAfter;
+
+    // Both sources are in path order, so one merge pass pairs every path
+    while (hasBefore || hasAfter)
+    {
+        if (hasBefore && hasAfter && before.path == after.path)
+        {
+            bool replaced = before.fileId != 0 && after.fileId != 0 && before.fileId != after.fileId;
+            if (before.size != after.size || before.lastWriteTime != after.lastWriteTime || replaced)
+            {
+                report({ DiffEntry::Kind::Changed, before, after });
+                differences++;
+            }
+            previousBefore.assign(before.path);
+            previousAfter.assign(after.path);
+            hasBefore = older.Read(before);
+            hasAfter = newer.Read(after);
+        }
+        else if (hasBefore && (!hasAfter || before.path < after.path))
+        {
+            previousBefore.assign(before.path);
+            removed.push_back(move(before));
+            hasBefore = older.Read(before);
+        }
+        else
+        {
+            previousAfter.assign(after.path);
+            added.push_back(move(after));
+            hasAfter = newer.Read(after);
+        }
+
+        // A source out of order would silently produce a wrong diff
+        if ((hasBefore && before.path < previousBefore) || (hasAfter && after.path < previousAfter))
+        {
+            throw runtime_error("Index is not sorted by path");
+        }
+    }
+
+    MatchMoves(removed, added, report, differences);
+
+    for (const auto& record : removed)
+    {
+        report({ DiffEntry::Kind::Removed, record, IndexRecord() });
+    }
+    for (const auto& record : added)
+    {
+        report({ DiffEntry::Kind::Added, IndexRecord(), record });
+    }
+    return differences + removed.size() + added.size();
+}
+
+template <typename OlderSource, typename NewerSource>
+void CIndexDiff<OlderSource, NewerSource>::MatchMoves(vector<IndexRecord>& removed, vector<IndexRecord>& added, const function<void(const DiffEntry&)>& report, size_t& differences)
+{
+    // Two passes: by file id where both sides know it (a moved file may also have changed),
+    // then by (name, size, timestamp)
+    for (int pass = 0; pass < 2; pass++)
+    {
+        // Sort the keys of the unmatched records and walk both lists in step
+        vector<MoveKey> removedKeys = vMoveKeys(removed, pass);
+        vector<MoveKey> addedKeys = vMoveKeys(added, pass);
+
+        vector<IndexRecord> unmatchedRemoved, unmatchedAdded;
+        size_t r = 0, a = 0;
+        while (r < removedKeys.size() || a < addedKeys.size())
+        {
+            if (r < removedKeys.size() && !removedKeys[r].eligible)
+            {
+                unmatchedRemoved.push_back(move(removed[removedKeys[r++].record]));
+            }
+            else if (a < addedKeys.size() && !addedKeys[a].eligible)
+            {
+                unmatchedAdded.push_back(move(added[addedKeys[a++].record]));
+            }
+            else if (r < removedKeys.size() && a < addedKeys.size() && removedKeys[r].Identity() == addedKeys[a].Identity())
+            {
+                report({ DiffEntry::Kind::Moved, removed[removedKeys[r++].record], added[addedKeys[a++].record] });
+                differences++;
+            }
+            else if (a == addedKeys.size() || (r < removedKeys.size() && removedKeys[r].Identity() < addedKeys[a].Identity()))
+            {
+                unmatchedRemoved.push_back(move(removed[removedKeys[r++].record]));
+            }
+            else
+            {
+                unmatchedAdded.push_back(move(added[addedKeys[a++].record]));
+            }
+        }
+        removed.swap(unmatchedRemoved);
+        added.swap(unmatchedAdded);
+    }
+
+    // Report what is left in path order
+    sort(removed.begin(), removed.end());
+    sort(added.begin(), added.end());
+}
+
+// Explicit template instantiation
+template class CIndexDiff<CIndexFileReader, CIndexFileReader>;
+template class CIndexDiff<CMemoryRecordSource, CIndexFileReader>;
+template class CIndexDiff<CIndexFileReader, CMemoryRecordSource>;
+template class CIndexDiff<CMemoryRecordSource, CMemoryRecordSource>;
@@ -0,0 +1,119 @@
+#include "IndexFile.h"
+#include <stdexcept>
+#include <cstring>
+
+// File header: magic followed by the format version
+static const char INDEX_MAGIC[4] = { 'F', 'I', 'D', 'X' };
+static const uint32_t INDEX_VERSION = 1;
+
+// Paths longer than this are treated as corruption rather than allocated
+static const uint32_t MAX_PATH_UNITS = 32767;
+
+static string Narrow(const wstring& text)
+{
+    return string(text.begin(), text.end());
+}
+
+IndexRecord IndexRecord::FromFindData(const wstring& path, const WIN32_FIND_DATA& findFileData, uint64_t key)
+{
+    IndexRecord record;
+    record.path = path;
+    record.size = (static_cast<uint64_t>(findFileData.nFileSizeHigh) << 32) | findFileData.nFileSizeLow;
+    record.lastWriteTime = (static_cast<uint64_t>(findFileData.ftLastWriteTime.dwHighDateTime) << 32) | findFileData.ftLastWriteTime.dwLowDateTime;
+    record.key = key;
+    return record;
+}
+
+CIndexFileWriter::CIndexFileWriter(const wstring& filePath) : filePath(filePath)
+{
+    file = _wfopen(filePath.c_str(), L"wb");
+    if (file == nullptr)
+    {
+        throw runtime_error("Cannot create index file " + Narrow(filePath));
+    }
+
+    // Large buffer so records are written in big sequential chunks
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC), file);
+    fwrite(&INDEX_VERSION, sizeof(INDEX_VERSION), 1, file);
+}
+
+CIndexFileWriter::~CIndexFileWriter()
+{
+    if (file != nullptr) fclose(file);
+}
+
+void CIndexFileWriter::Write(const IndexRecord& record)
+{
+    uint32_t length = static_cast<uint32_t>(record.path.size());
+    fwrite(&record.key, sizeof(record.key), 1, file);
+    fwrite(&record.size, sizeof(record.size), 1, file);
+    fwrite(&record.lastWriteTime, sizeof(record.lastWriteTime), 1, file);
+    fwrite(&record.fileId, sizeof(record.fileId), 1, file);
+    fwrite(&length, sizeof(length), 1, file);
+    if (fwrite(record.path.data(), sizeof(wchar_t), length, file) != length)
+    {
+        throw runtime_error("Cannot write index file " + Narrow(filePath));
+    }
+}
+
+void CIndexFileWriter::Close()
+{
+    if (file == nullptr) return;
+
+    bool failed = (fflush(file) != 0);
+    fclose(file);
+    file = nullptr;
+
+    if (failed)
+    {
+        throw runtime_error("Cannot flush index file " + Narrow(filePath));
+    }
+}
+
+CIndexFileReader::CIndexFileReader(const wstring& filePath) : filePath(filePath)
+{
+    file = _wfopen(filePath.c_str(), L"rb");
+    if (file == nullptr)
+    {
+        throw runtime_error("Cannot open index file " + Narrow(filePath));
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    char magic[4];
+    uint32_t version = 0;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 || version != INDEX_VERSION)
+    {
+        fclose(file);
+        file = nullptr;
+        throw runtime_error("Not an index file: " + Narrow(filePath));
+    }
+}
+
+CIndexFileReader::~CIndexFileReader()
+{
+    if (file != nullptr) fclose(file);
+}
+
+bool CIndexFileReader::Read(IndexRecord& record)
+{
+    uint32_t length = 0;
+    if (fread(&record.key, sizeof(record.key), 1, file) != 1) return false;
+
+    if (fread(&record.size, sizeof(record.size), 1, file) != 1 ||
+        fread(&record.lastWriteTime, sizeof(record.lastWriteTime), 1, file) != 1 ||
+        fread(&record.fileId, sizeof(record.fileId), 1, file) != 1 ||
+        fread(&length, sizeof(length), 1, file) != 1 || length > MAX_PATH_UNITS)
+    {
+        throw runtime_error("Truncated or corrupt index file " + Narrow(filePath));
+    }
+
+    record.path.resize(length);
+    if (fread(&record.path[0], sizeof(wchar_t), length, file) != length)
+    {
+        throw runtime_error("Truncated or corrupt index file " + Narrow(filePath));
+    }
+    return true;
+}
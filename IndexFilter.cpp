@@ -0,0 +1,325 @@
+#include "IndexFilter.h"
+#include <cwctype>
+
+// Windows file names compare case-insensitively, so every rule is matched on folded characters
+static inline wchar_t fold(wchar_t c)
+{
+    return (c < 0x80) ? ((c >= L'A' && c <= L'Z') ? wchar_t(c + 32) : c) : wchar_t(towlower(c));
+}
+
+// Returns true if the pattern contains glob metacharacters
+static bool bHasWildcards(const wstring& pattern)
+{
+    return pattern.find_first_of(L"*?[") != wstring::npos;
+}
+
+// FNV-1a over folded characters
+size_t CNameSet::hash(const wchar_t* name, size_t length)
+{
+    size_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= size_t(fold(name[i]));
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void CNameSet::rehash(size_t capacity)
+{
+    vector<wstring> old;
+    old.swap(slots);
+    slots.assign(capacity, wstring());
+    count = 0;
+    for (const auto& name : old)
+    {
+        if (!name.empty()) insert(name);
+    }
+}
+
+void CNameSet::insert(const wstring& name)
+{
+    if (name.empty()) return;
+
+    // Keep the load factor at or below one half so probes stay short
+    if ((count + 1) * 2 > slots.size()) rehash(slots.empty() ? 16 : slots.size() * 2);
+
+    wstring folded(name);
+    for (auto& c : folded) c = fold(c);
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(folded.c_str(), folded.size()) & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i].empty())
+        {
+            slots[i] = folded;
+            count++;
+            return;
+        }
+        if (slots[i] == folded) return;
+    }
+}
+
+bool CNameSet::contains(const wchar_t* name, size_t length) const
+{
+    if (count == 0 || length == 0) return false;
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(name, length) & mask; !slots[i].empty(); i = (i + 1) & mask)
+    {
+        const wstring& slot = slots[i];
+        if (slot.size() != length) continue;
+
+        size_t j = 0;
+        while (j < length && slot[j] == fold(name[j])) j++;
+        if (j == length) return true;
+    }
+    return false;
+}
+
+// Compile the glob into literal, '?', '*' and '[...]' tokens
+CGlobPattern::CGlobPattern(const wstring& pattern)
+{
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        Token token{ TokenType::Literal, 0, false, {} };
+        wchar_t c = pattern[i];
+
+        if (c == L'*')
+        {
+            // Collapse runs of '*' into a single token
+            if (!tokens.empty() && tokens.back().type == TokenType::AnySequence) continue;
+            token.type = TokenType::AnySequence;
+        }
+        else if (c == L'?')
+        {
+            token.type = TokenType::AnyChar;
+        }
+        else if (c == L'[' && pattern.find(L']', i + 1) != wstring::npos)
+        {
+            token.type = TokenType::CharClass;
+            i++;
+            if (pattern[i] == L'!' || pattern[i] == L'^')
+            {
+                token.negated = true;
+                i++;
+            }
+            // A ']' directly after the opening bracket is a literal member
+            do
+            {
+                wchar_t low = fold(pattern[i]);
+                wchar_t high = low;
+                if (i + 2 < pattern.size() && pattern[i + 1] == L'-' && pattern[i + 2] != L']')
+                {
+                    high = fold(pattern[i + 2]);
+                    i += 2;
+                }
+                token.ranges.push_back({ low, high });
+                i++;
+            } while (i < pattern.size() && pattern[i] != L']');
+        }
+        else
+        {
+            if (c == L'\\' && i + 1 < pattern.size()) c = pattern[++i];
+            token.literal = fold(c);
+        }
+        tokens.push_back(token);
+    }
+}
+
+bool CGlobPattern::matchToken(const Token& token, wchar_t c) const
+{
+    switch (token.type)
+    {
+    case TokenType::Literal:
+        return token.literal == c;
+    case TokenType::AnyChar:
+        return true;
+    case TokenType::CharClass:
+    {
+        bool found = false;
+        for (const auto& range : token.ranges)
+        {
+            if (c >= range.first && c <= range.second)
+            {
+                found = true;
+                break;
+            }
+        }
+        return found != token.negated;
+    }
+    default:
+        return false;
+    }
+}
+
+// Linear-time match that only backtracks to the most recent '*'
+bool CGlobPattern::match(const wchar_t* name, size_t length) const
+{
+    size_t t = 0, n = 0;
+    size_t starToken = SIZE_MAX, starName = 0;
+
+    while (n < length)
+    {
+        if (t < tokens.size() && tokens[t].type == TokenType::AnySequence)
+        {
+            starToken = t++;
+            starName = n;
+        }
+        else if (t < tokens.size() && matchToken(tokens[t], fold(name[n])))
+        {
+            t++;
+            n++;
+        }
+        else if (starToken != SIZE_MAX)
+        {
+            t = starToken + 1;
+            n = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (t < tokens.size() && tokens[t].type == TokenType::AnySequence) t++;
+    return t == tokens.size();
+}
+
+// Route each pattern to the cheapest structure that can answer it
+void CIndexFilter::RuleSet::add(const wstring& pattern)
+{
+    if (pattern.empty()) return;
+
+    if (!bHasWildcards(pattern))
+    {
+        names.insert(pattern);
+    }
+    else if (pattern.size() > 2 && pattern[0] == L'*' && pattern[1] == L'.' && !bHasWildcards(pattern.substr(2)))
+    {
+        extensions.insert(pattern.substr(2));
+    }
+    else
+    {
+        globs.emplace_back(pattern);
+    }
+}
+
+// Returns true if the suffix after any '.' in the name is in the set
+static bool bMatchExtension(const CNameSet& extensions, const wchar_t* name, size_t length)
+{
+    if (extensions.empty()) return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (name[i] == L'.' && extensions.contains(name + i + 1, length - i - 1)) return true;
+    }
+    return false;
+}
+
+bool CIndexFilter::RuleSet::match(const wchar_t* name, size_t length) const
+{
+    if (names.contains(name, length)) return true;
+    if (bMatchExtension(extensions, name, length)) return true;
+    for (const auto& glob : globs)
+    {
+        if (glob.match(name, length)) return true;
+    }
+    return false;
+}
+
+// Compile the rules once so per-entry checks are hash probes and token walks
+CIndexFilter::CIndexFilter(const FilterRules& rules) : rules(rules)
+{
+    for (wstring pattern : rules.excludePatterns)
+    {
+        if (pattern.empty() || pattern[0] == L'#') continue;
+
+        if (pattern[0] == L'!')
+        {
+            reinclude.add(pattern.substr(1));
+            continue;
+        }
+
+        // Only name patterns are supported, so a leading '/' anchor is dropped
+        if (pattern[0] == L'/') pattern.erase(0, 1);
+
+        if (!pattern.empty() && pattern.back() == L'/')
+        {
+            pattern.pop_back();
+            excludeDirectories.add(pattern);
+        }
+        else
+        {
+            excludeAny.add(pattern);
+        }
+    }
+
+    for (const auto& pattern : rules.includePatterns)
+    {
+        include.add(pattern);
+    }
+
+    for (const auto& extension : rules.extensions)
+    {
+        extensions.insert(!extension.empty() && extension[0] == L'.' ? extension.substr(1) : extension);
+    }
+}
+
+bool CIndexFilter::bExcluded(const wchar_t* name, size_t length, bool isDirectory) const
+{
+    bool excluded = excludeAny.match(name, length) || (isDirectory && excludeDirectories.match(name, length));
+    return excluded && !reinclude.match(name, length);
+}
+
+bool CIndexFilter::bAcceptDirectory(const WIN32_FIND_DATA& findFileData, int depth) const
+{
+    if (rules.maxDepth >= 0 && depth > rules.maxDepth) return false;
+
+    if (rules.skipHidden && (findFileData.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) return false;
+
+    if (!rules.crossFilesystems && (findFileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) return false;
+
+    // For reparse points the find data carries the reparse tag; symbolic links can form cycles
+    if (!rules.followLinks && (findFileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && findFileData.dwReserved0 == IO_REPARSE_TAG_SYMLINK) return false;
+
+    return !bExcluded(findFileData.cFileName, wcslen(findFileData.cFileName), true);
+}
+
+bool CIndexFilter::bAcceptFile(const WIN32_FIND_DATA& findFileData) const
+{
+    if (rules.skipHidden && (findFileData.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) return false;
+
+    unsigned long long size = (static_cast<unsigned long long>(findFileData.nFileSizeHigh) << 32) | findFileData.nFileSizeLow;
+    if (size < rules.minFileSize) return false;
+    if (rules.maxFileSize != 0 && size > rules.maxFileSize) return false;
+
+    const wchar_t* name = findFileData.cFileName;
+    size_t length = wcslen(name);
+
+    if (!extensions.empty() && !bMatchExtension(extensions, name, length)) return false;
+
+    if (!include.empty() && !include.match(name, length)) return false;
+
+    return !bExcluded(name, length, false);
+}
+
+vector<wstring> vSplitPatterns(const wstring& list)
+{
+    vector<wstring> patterns;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(L';', start);
+        if (end == wstring::npos) end = list.size();
+
+        // Trim surrounding spaces
+        size_t first = list.find_first_not_of(L' ', start);
+        size_t last = list.find_last_not_of(L' ', end == 0 ? 0 : end - 1);
+        if (first != wstring::npos && first < end && last != wstring::npos && last >= first)
+        {
+            patterns.push_back(list.substr(first, last - first + 1));
+        }
+        start = end + 1;
+    }
+    return patterns;
+}
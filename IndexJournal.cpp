@@ -0,0 +1,306 @@
+#include "IndexJournal.h"
+#include <windows.h>
+#include <io.h>
+#include <stdexcept>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// File header: magic, format version and the root the walk started from
+static const char JOURNAL_MAGIC[4] = { 'F', 'J', 'N', 'L' };
+static const uint32_t JOURNAL_VERSION = 2;
+
+// Records longer than this are treated as corruption rather than allocated
+static const uint32_t MAX_RECORD_BYTES = 1u << 28;
+
+static string Narrow(const wstring& text)
+{
+    return string(text.begin(), text.end());
+}
+
+// Reflected CRC-32 (IEEE 802.3), one table lookup per byte
+uint32_t CIndexJournal::Crc32(const void* data, size_t length, uint32_t crc)
+{
+    static const auto table = []()
+        {
+            vector<uint32_t> entries(256);
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++) value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+                entries[i] = value;
+            }
+            return entries;
+        }();
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Little helpers for the record payload: fixed-width integers and length-prefixed UTF-16 strings
+static void vPut(vector<uint8_t>& buffer, const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + length);
+}
+
+static void vPutString(vector<uint8_t>& buffer, const wstring& text)
+{
+    uint32_t length = static_cast<uint32_t>(text.size());
+    vPut(buffer, &length, sizeof(length));
+    vPut(buffer, text.data(), length * sizeof(wchar_t));
+}
+
+static void vPutIdentity(vector<uint8_t>& buffer, const FileIdentity& identity)
+{
+    uint32_t volumeSerial = identity.volumeSerial;
+    uint64_t fileIndex = identity.fileIndex;
+    vPut(buffer, &volumeSerial, sizeof(volumeSerial));
+    vPut(buffer, &fileIndex, sizeof(fileIndex));
+}
+
+// Reads from a payload whose checksum already matched; fails instead of reading past the end
+struct PayloadReader
+{
+    const uint8_t* position;
+    const uint8_t* end;
+
+    bool Get(void* data, size_t length)
+    {
+        if (static_cast<size_t>(end - position) < length) return false;
+        memcpy(data, position, length);
+        position += length;
+        return true;
+    }
+
+    bool GetString(wstring& text)
+    {
+        uint32_t length;
+        if (!Get(&length, sizeof(length)) || length > static_cast<size_t>(end - position) / sizeof(wchar_t)) return false;
+        text.resize(length);
+        return length == 0 || Get(&text[0], length * sizeof(wchar_t));
+    }
+
+    bool GetIdentity(FileIdentity& identity)
+    {
+        uint32_t volumeSerial;
+        uint64_t fileIndex;
+        if (!Get(&volumeSerial, sizeof(volumeSerial)) || !Get(&fileIndex, sizeof(fileIndex))) return false;
+        identity.volumeSerial = volumeSerial;
+        identity.fileIndex = fileIndex;
+        return true;
+    }
+};
+
+static bool bParseDirectory(const vector<uint8_t>& payload, JournalDirectory& directory)
+{
+    PayloadReader reader{ payload.data(), payload.data() + payload.size() };
+    uint32_t count;
+
+    if (!reader.GetString(directory.path) || !reader.Get(&count, sizeof(count))) return false;
+    directory.files.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        JournalEntry entry;
+        if (!reader.GetString(entry.name) || !reader.Get(&entry.size, sizeof(entry.size)) ||
+            !reader.Get(&entry.lastWriteTime, sizeof(entry.lastWriteTime)) || !reader.GetIdentity(entry.identity)) return false;
+        directory.files.push_back(move(entry));
+    }
+
+    if (!reader.Get(&count, sizeof(count))) return false;
+    directory.subdirectories.resize(count);
+    directory.subdirectoryIdentities.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!reader.GetString(directory.subdirectories[i]) || !reader.GetIdentity(directory.subdirectoryIdentities[i])) return false;
+    }
+    return reader.position == reader.end;
+}
+
+CIndexJournal::CIndexJournal(const wstring& journalPath, const wstring& root) : journalPath(journalPath), root(root)
+{
+}
+
+CIndexJournal::~CIndexJournal()
+{
+    if (file != nullptr) fclose(file);
+}
+
+vector<PendingDirectory> CIndexJournal::Recover(const function<void(const JournalDirectory&)>& replay)
+{
+    lock_guard<mutex> lock(journalMutex);
+    if (recoveredOnce)
+    {
+        throw runtime_error("Journal already recovered: " + Narrow(journalPath));
+    }
+    recoveredOnce = true;
+
+    // Directories completed, and directories listed by a completed parent in listing order
+    unordered_set<wstring> completed;
+    vector<PendingDirectory> listed;
+    unordered_map<wstring, int> depths;
+    depths[root] = 0;
+
+    long long validEnd = 0;
+    FILE* existing = _wfopen(journalPath.c_str(), L"rb");
+    if (existing != nullptr)
+    {
+        setvbuf(existing, nullptr, _IOFBF, 1 << 20);
+
+        char magic[4];
+        uint32_t version = 0;
+        wstring journalRoot;
+        uint32_t rootLength = 0;
+        bool headerValid = fread(magic, 1, sizeof(magic), existing) == sizeof(magic) && memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0 &&
+            fread(&version, sizeof(version), 1, existing) == 1 && version == JOURNAL_VERSION &&
+            fread(&rootLength, sizeof(rootLength), 1, existing) == 1 && rootLength <= 32767;
+        if (headerValid)
+        {
+            journalRoot.resize(rootLength);
+            headerValid = rootLength == 0 || fread(&journalRoot[0], sizeof(wchar_t), rootLength, existing) == rootLength;
+        }
+
+        if (headerValid && journalRoot != root)
+        {
+            fclose(existing);
+            throw runtime_error("Journal " + Narrow(journalPath) + " belongs to another root: " + Narrow(journalRoot));
+        }
+
+        // A torn header means nothing after it was ever written; the journal starts over
+        if (headerValid)
+        {
+            validEnd = _ftelli64(existing);
+
+            // Read records until the end of the file or the first one that is torn or fails its checksum
+            vector<uint8_t> payload;
+            JournalDirectory directory;
+            while (true)
+            {
+                uint32_t header[2];
+                if (fread(header, sizeof(header), 1, existing) != 1 || header[0] > MAX_RECORD_BYTES) break;
+
+                payload.resize(header[0]);
+                if (header[0] != 0 && fread(payload.data(), 1, header[0], existing) != header[0]) break;
+                if (Crc32(payload.data(), payload.size()) != header[1] || !bParseDirectory(payload, directory)) break;
+
+                validEnd += sizeof(header) + header[0];
+                recovered++;
+
+                completed.insert(directory.path);
+                int depth = depths.count(directory.path) ? depths[directory.path] : 0;
+                for (const auto& subdirectory : directory.subdirectories)
+                {
+                    wstring path = directory.path + L"\\" + subdirectory;
+                    depths[path] = depth + 1;
+                    listed.push_back({ path, depth + 1 });
+                }
+                replay(directory);
+            }
+
+            _fseeki64(existing, 0, SEEK_END);
+            truncated = static_cast<uint64_t>(_ftelli64(existing) - validEnd);
+        }
+        fclose(existing);
+    }
+
+    if (validEnd > 0)
+    {
+        // Cut the torn tail so new records follow the last intact one
+        file = _wfopen(journalPath.c_str(), L"r+b");
+        if (file == nullptr || _chsize_s(_fileno(file), validEnd) != 0)
+        {
+            throw runtime_error("Cannot truncate journal " + Narrow(journalPath));
+        }
+        _fseeki64(file, 0, SEEK_END);
+    }
+    else
+    {
+        file = _wfopen(journalPath.c_str(), L"wb");
+        if (file == nullptr)
+        {
+            throw runtime_error("Cannot create journal " + Narrow(journalPath));
+        }
+
+        uint32_t rootLength = static_cast<uint32_t>(root.size());
+        fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), file);
+        fwrite(&JOURNAL_VERSION, sizeof(JOURNAL_VERSION), 1, file);
+        fwrite(&rootLength, sizeof(rootLength), 1, file);
+        fwrite(root.data(), sizeof(wchar_t), rootLength, file);
+        if (fflush(file) != 0)
+        {
+            throw runtime_error("Cannot write journal " + Narrow(journalPath));
+        }
+    }
+
+    // Resume from everything listed but not completed; a walk with no completed directory restarts at the root
+    vector<PendingDirectory> pending;
+    if (completed.count(root) == 0)
+    {
+        pending.push_back({ root, 0 });
+    }
+    for (auto& directory : listed)
+    {
+        if (completed.count(directory.path) == 0) pending.push_back(move(directory));
+    }
+    return pending;
+}
+
+void CIndexJournal::Append(const JournalDirectory& directory)
+{
+    // Build the whole record first so it reaches the file in one write
+    vector<uint8_t> record(2 * sizeof(uint32_t));
+    vPutString(record, directory.path);
+    uint32_t count = static_cast<uint32_t>(directory.files.size());
+    vPut(record, &count, sizeof(count));
+    for (const auto& entry : directory.files)
+    {
+        vPutString(record, entry.name);
+        vPut(record, &entry.size, sizeof(entry.size));
+        vPut(record, &entry.lastWriteTime, sizeof(entry.lastWriteTime));
+        vPutIdentity(record, entry.identity);
+    }
+    count = static_cast<uint32_t>(directory.subdirectories.size());
+    vPut(record, &count, sizeof(count));
+    for (size_t i = 0; i < directory.subdirectories.size(); i++)
+    {
+        vPutString(record, directory.subdirectories[i]);
+        vPutIdentity(record, i < directory.subdirectoryIdentities.size() ? directory.subdirectoryIdentities[i] : FileIdentity());
+    }
+
+    uint32_t header[2] = { static_cast<uint32_t>(record.size() - sizeof(header)), 0 };
+    header[1] = Crc32(record.data() + sizeof(header), header[0]);
+    memcpy(record.data(), header, sizeof(header));
+
+    lock_guard<mutex> lock(journalMutex);
+    if (file == nullptr)
+    {
+        throw runtime_error("Journal not recovered before use: " + Narrow(journalPath));
+    }
+
+    // Flushed records survive the process being killed; the periodic commit covers a system crash
+    if (fwrite(record.data(), 1, record.size(), file) != record.size() || fflush(file) != 0)
+    {
+        throw runtime_error("Cannot write journal " + Narrow(journalPath));
+    }
+    if (++unsynced >= syncInterval)
+    {
+        _commit(_fileno(file));
+        unsynced = 0;
+    }
+}
+
+void CIndexJournal::Complete()
+{
+    lock_guard<mutex> lock(journalMutex);
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+    DeleteFile(journalPath.c_str());
+}
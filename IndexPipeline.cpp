@@ -0,0 +1,66 @@
+#include "IndexPipeline.h"
+#include <locale>
+#include <codecvt>
+
+CIndexerFacade::CIndexerFacade(IndexMethod method, const CIndexFilter* filter) : method(method), filter(filter) {}
+
+// Choose the filter policy, the last runtime decision before the specialized loop
+template <KeyExtractor K, typename S>
+size_t CIndexerFacade::Run(const wstring& directory, K keyExtractor, S sink)
+{
+    if (filter != nullptr)
+    {
+        CIndexPipeline<Win32Walker, RuleFilter, K, S> pipeline(Win32Walker{ filter->Rules() }, RuleFilter{ *filter }, keyExtractor, sink);
+        return pipeline.Run(directory);
+    }
+
+    CIndexPipeline<Win32Walker, NoFilter, K, S> pipeline(Win32Walker(), NoFilter(), keyExtractor, sink);
+    return pipeline.Run(directory);
+}
+
+size_t CIndexerFacade::IndexDirectory(const wstring& directory)
+{
+    switch (method)
+    {
+    case IndexMethod::BinaryTree:
+        return Run(directory, NoKey(), BstSink{ bst });
+    case IndexMethod::Btree:
+        return Run(directory, CodePointSumKey(), BtreeSink{ btreeIndex });
+    case IndexMethod::Hashing:
+        return Run(directory, PolynomialHashKey(), HashMapSink{ hashIndex });
+    }
+    return 0;
+}
+
+void CIndexerFacade::PrintIndex()
+{
+    switch (method)
+    {
+    case IndexMethod::BinaryTree:
+    {
+        bst.traverse();
+        break;
+    }
+    case IndexMethod::Btree:
+    {
+        wstring_convert<codecvt_utf8<wchar_t>> converter;
+        for (auto it = btreeIndex.begin(); it != btreeIndex.end(); it++)
+        {
+            cout << "Key: " << it->first << ", Value: " << converter.to_bytes(it->second) << endl;
+        }
+        break;
+    }
+    case IndexMethod::Hashing:
+    {
+        for (auto it = hashIndex.begin(); it != hashIndex.end(); it++)
+        {
+            cout << "Index key " << it->first << " : " << endl;
+            for (auto it2 = it->second.begin(); it2 != it->second.end(); it2++)
+            {
+                wcout << "  " << *it2 << endl;
+            }
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,123 @@
+#include "IoThrottle.h"
+#include <algorithm>
+#include <thread>
+
+CIoThrottle::CIoThrottle(const ThrottleConfig& config, unsigned maxConcurrency)
+    : config(config), maxConcurrency(max(1u, maxConcurrency)), refilled(chrono::steady_clock::now())
+{
+    // A tenth of a second of reads may start back to back; beyond that they are spaced evenly
+    burst = max(1.0, config.maxDirectoriesPerSecond / 10);
+    tokens = burst;
+
+    // Adaptive concurrency starts at the full pool and backs off from there
+    limit = this->maxConcurrency;
+}
+
+unsigned CIoThrottle::Concurrency() const
+{
+    lock_guard<mutex> lock(throttleMutex);
+    return limit;
+}
+
+void CIoThrottle::Acquire()
+{
+    unique_lock<mutex> lock(throttleMutex);
+
+    // Wait for a concurrency slot
+    slotFree.wait(lock, [&]() { return active < limit; });
+    active++;
+
+    if (config.maxDirectoriesPerSecond <= 0) return;
+
+    // Refill the bucket, then take a token; a negative balance is a reservation to sleep off
+    auto now = chrono::steady_clock::now();
+    tokens = min(burst, tokens + chrono::duration<double>(now - refilled).count() * config.maxDirectoriesPerSecond);
+    refilled = now;
+    tokens -= 1;
+
+    if (tokens < 0)
+    {
+        auto wait = chrono::duration<double>(-tokens / config.maxDirectoriesPerSecond);
+        lock.unlock();
+        this_thread::sleep_for(wait);
+    }
+}
+
+void CIoThrottle::Release(chrono::nanoseconds callTime, unsigned calls)
+{
+    {
+        lock_guard<mutex> lock(throttleMutex);
+        active--;
+
+        if (config.latencyTargetMicroseconds > 0)
+        {
+            windowLatency += chrono::duration<double, micro>(callTime).count() / max(1u, calls);
+
+            if (++windowSamples == WINDOW)
+            {
+                double mean = windowLatency / WINDOW;
+                windowSamples = 0;
+                windowLatency = 0;
+
+                // Additive increase while comfortably under target, multiplicative decrease above it
+                if (mean > config.latencyTargetMicroseconds)
+                {
+                    limit = max(1u, limit / 2);
+                }
+                else if (mean < config.latencyTargetMicroseconds * 0.8 && limit < maxConcurrency)
+                {
+                    limit++;
+                }
+            }
+        }
+    }
+    slotFree.notify_all();
+}
+
+CIoThrottle::CPriorityScope::CPriorityScope(const CIoThrottle& throttle)
+{
+    switch (throttle.config.priority)
+    {
+    case IoPriority::Low:
+        previousPriority = GetThreadPriority(GetCurrentThread());
+        if (previousPriority != THREAD_PRIORITY_ERROR_RETURN && SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL))
+        {
+            applied = IoPriority::Low;
+        }
+        break;
+    case IoPriority::Idle:
+        // Fails with ERROR_THREAD_MODE_ALREADY_BACKGROUND when an outer scope already began it
+        if (SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN))
+        {
+            applied = IoPriority::Idle;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+CIoThrottle::CPriorityScope::~CPriorityScope()
+{
+    switch (applied)
+    {
+    case IoPriority::Low:
+        SetThreadPriority(GetCurrentThread(), previousPriority);
+        break;
+    case IoPriority::Idle:
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+        break;
+    default:
+        break;
+    }
+}
+
+CIoThrottle::CSlot::CSlot(CIoThrottle& throttle) : throttle(throttle), priority(throttle)
+{
+    throttle.Acquire();
+}
+
+CIoThrottle::CSlot::~CSlot()
+{
+    throttle.Release(chrono::duration_cast<chrono::nanoseconds>(callTime), calls);
+}
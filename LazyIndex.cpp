@@ -0,0 +1,256 @@
+#include "LazyIndex.h"
+#include "LinkTracker.h"
+#include "NameKey.h"
+#include <stdexcept>
+
+CLazyIndex::CLazyIndex(const wstring& root, const CIndexFilter* filter) : root(root), filter(filter)
+{
+    while (this->root.size() > 1 && (this->root.back() == L'\\' || this->root.back() == L'/')) this->root.pop_back();
+
+    WIN32_FILE_ATTRIBUTE_DATA rootData;
+    if (!GetFileAttributesEx(this->root.c_str(), GetFileExInfoStandard, &rootData) || !(rootData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        throw runtime_error("Invalid handle value. Directory not found or access denied.");
+    }
+
+    // Nothing is read up front; the root starts as the only placeholder
+    listings[Key(this->root)] = nullptr;
+}
+
+wstring CLazyIndex::Key(const wstring& path)
+{
+    wstring key(path);
+    for (auto& c : key)
+    {
+        if (c == L'/') c = L'\\';
+    }
+    while (key.size() > 1 && key.back() == L'\\') key.pop_back();
+    return FoldName(key);
+}
+
+shared_ptr<const CLazyIndex::Listing> CLazyIndex::Expand(const wstring& path, int depth)
+{
+    wstring key = Key(path);
+
+    // The last-write time is read before enumerating, so a change made during the read makes the listing stale
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &attributes) || !(attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        unique_lock<shared_mutex> lock(listingsMutex);
+        listings.erase(key);
+        return nullptr;
+    }
+
+    {
+        shared_lock<shared_mutex> lock(listingsMutex);
+        auto found = listings.find(key);
+        if (found != listings.end() && found->second &&
+            found->second->lastWriteTime.dwLowDateTime == attributes.ftLastWriteTime.dwLowDateTime &&
+            found->second->lastWriteTime.dwHighDateTime == attributes.ftLastWriteTime.dwHighDateTime)
+        {
+            return found->second;
+        }
+    }
+
+    // Read the directory without holding the lock; concurrent readers of the same directory just race to publish
+    auto listing = make_shared<Listing>();
+    listing->lastWriteTime = attributes.ftLastWriteTime;
+
+    WIN32_FIND_DATA findFileData;
+    wstring searchPath = path + L"\\*";
+    HANDLE hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            // Ignore "." and ".." directories
+            if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (filter != nullptr && !filter->bAcceptDirectory(findFileData, depth + 1)) continue;
+                listing->subdirectories.push_back(findFileData.cFileName);
+                listing->subdirectoryAttributes.push_back(findFileData.dwFileAttributes);
+            }
+            else
+            {
+                if (filter != nullptr && !filter->bAcceptFile(findFileData)) continue;
+                listing->files.push_back(findFileData.cFileName);
+            }
+        } while (FindNextFile(hFind, &findFileData) != 0);
+
+        FindClose(hFind);
+    }
+    expansions++;
+
+    // Publish the listing and record its subdirectories as placeholders. On a re-read, subdirectories the
+    // previous listing had and this one lacks were deleted or renamed, so their cached subtrees are dropped
+    unique_lock<shared_mutex> lock(listingsMutex);
+    auto previous = listings.find(key);
+    if (previous != listings.end() && previous->second)
+    {
+        unordered_set<wstring> current;
+        for (const auto& subdirectory : listing->subdirectories) current.insert(Key(subdirectory));
+
+        shared_ptr<const Listing> stale = previous->second;
+        for (const auto& subdirectory : stale->subdirectories)
+        {
+            if (current.count(Key(subdirectory)) == 0) EraseSubtree(Key(path + L"\\" + subdirectory));
+        }
+    }
+    for (const auto& subdirectory : listing->subdirectories)
+    {
+        listings.try_emplace(Key(path + L"\\" + subdirectory), nullptr);
+    }
+    listings[key] = listing;
+    return listing;
+}
+
+void CLazyIndex::EraseSubtree(const wstring& key)
+{
+    // Follow the cached listings down rather than scanning every key for the prefix
+    vector<wstring> pending;
+    pending.push_back(key);
+    while (!pending.empty())
+    {
+        wstring current = move(pending.back());
+        pending.pop_back();
+
+        auto found = listings.find(current);
+        if (found == listings.end()) continue;
+        if (found->second)
+        {
+            for (const auto& subdirectory : found->second->subdirectories) pending.push_back(Key(current + L"\\" + subdirectory));
+        }
+        listings.erase(found);
+    }
+}
+
+bool CLazyIndex::Resolve(const wstring& directory, wstring& path, int& depth)
+{
+    wstring relative = Key(directory);
+    wstring rootKey = Key(root);
+
+    // Accept paths under the root as well as paths relative to it
+    if (relative.compare(0, rootKey.size(), rootKey) == 0 && (relative.size() == rootKey.size() || relative[rootKey.size()] == L'\\'))
+    {
+        relative.erase(0, rootKey.size());
+    }
+
+    path = root;
+    depth = 0;
+
+    size_t start = 0;
+    while (start < relative.size())
+    {
+        size_t end = relative.find(L'\\', start);
+        if (end == wstring::npos) end = relative.size();
+        wstring component = relative.substr(start, end - start);
+        start = end + 1;
+        if (component.empty() || component == L".") continue;
+
+        // Only the directories on the way down are read; their siblings stay placeholders
+        shared_ptr<const Listing> listing = Expand(path, depth);
+        if (!listing) return false;
+
+        const wstring* match = nullptr;
+        for (const auto& subdirectory : listing->subdirectories)
+        {
+            if (Key(subdirectory) == component)
+            {
+                match = &subdirectory;
+                break;
+            }
+        }
+        if (match == nullptr) return false;
+
+        path += L"\\" + *match;
+        depth++;
+    }
+    return true;
+}
+
+bool CLazyIndex::List(const wstring& directory, vector<wstring>& files, vector<wstring>& subdirectories)
+{
+    wstring path;
+    int depth;
+    if (!Resolve(directory, path, depth)) return false;
+
+    shared_ptr<const Listing> listing = Expand(path, depth);
+    if (!listing) return false;
+
+    files = listing->files;
+    subdirectories = listing->subdirectories;
+    return true;
+}
+
+void CLazyIndex::ForEachFile(const wstring& directory, const function<void(const wstring& path)>& visit)
+{
+    wstring path;
+    int depth;
+    if (!Resolve(directory, path, depth)) return;
+
+    // Junctions are always checked for cycles; the rules decide whether links are followed and hard links merged
+    CLinkTracker links(filter != nullptr ? filter->Rules() : FilterRules());
+    links.AddRoot(path);
+
+    // Depth-first over an explicit stack so deep trees cannot overflow the call stack
+    vector<pair<wstring, int>> pending;
+    pending.push_back({ path, depth });
+    while (!pending.empty())
+    {
+        auto current = move(pending.back());
+        pending.pop_back();
+
+        shared_ptr<const Listing> listing = Expand(current.first, current.second);
+        if (!listing) continue;
+
+        for (const auto& file : listing->files)
+        {
+            wstring filePath = current.first + L"\\" + file;
+            uint64_t fileId;
+            if (!links.bAcceptFile(filePath, fileId)) continue;
+            visit(filePath);
+        }
+        for (size_t i = listing->subdirectories.size(); i-- > 0;)
+        {
+            wstring subdirectory = current.first + L"\\" + listing->subdirectories[i];
+            if (!links.bEnterDirectory(subdirectory, listing->subdirectoryAttributes[i])) continue;
+            pending.push_back({ move(subdirectory), current.second + 1 });
+        }
+    }
+}
+
+vector<wstring> CLazyIndex::Find(const wstring& directory, const wstring& name)
+{
+    wstring wanted = Key(name);
+    vector<wstring> found;
+    ForEachFile(directory, [&](const wstring& path)
+        {
+            size_t slash = path.find_last_of(L'\\');
+            if (Key(path.substr(slash + 1)) == wanted) found.push_back(path);
+        });
+    return found;
+}
+
+size_t CLazyIndex::ExpandedCount() const
+{
+    shared_lock<shared_mutex> lock(listingsMutex);
+    size_t expanded = 0;
+    for (const auto& entry : listings)
+    {
+        if (entry.second) expanded++;
+    }
+    return expanded;
+}
+
+size_t CLazyIndex::PlaceholderCount() const
+{
+    shared_lock<shared_mutex> lock(listingsMutex);
+    size_t placeholders = 0;
+    for (const auto& entry : listings)
+    {
+        if (!entry.second) placeholders++;
+    }
+    return placeholders;
+}
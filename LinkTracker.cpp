@@ -0,0 +1,104 @@
+#include "LinkTracker.h"
+
+size_t CIdentitySet::Hasher::operator()(const FileIdentity& identity) const
+{
+    uint64_t key = identity.fileIndex ^ (uint64_t(identity.volumeSerial) << 32);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+}
+
+bool CIdentitySet::Insert(const FileIdentity& identity)
+{
+    // High hash bits pick the stripe, so the stripe's own table still sees well-mixed low bits
+    Stripe& stripe = stripes[(Hasher()(identity) >> 58) % STRIPES];
+    lock_guard<mutex> lock(stripe.stripeMutex);
+    return stripe.identities.insert(identity).second;
+}
+
+size_t CIdentitySet::size() const
+{
+    size_t count = 0;
+    for (const auto& stripe : stripes)
+    {
+        lock_guard<mutex> lock(stripe.stripeMutex);
+        count += stripe.identities.size();
+    }
+    return count;
+}
+
+CLinkTracker::CLinkTracker(const FilterRules& rules) : followLinks(rules.followLinks), dedupHardlinks(rules.dedupHardlinks)
+{
+}
+
+bool CLinkTracker::bQueryIdentity(const wstring& path, FileIdentity& identity, DWORD& links)
+{
+    // Backup semantics lets directories be opened; attribute access is enough for the identity
+    HANDLE handle = CreateFile(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION information;
+    BOOL queried = GetFileInformationByHandle(handle, &information);
+    CloseHandle(handle);
+    if (!queried) return false;
+
+    identity.volumeSerial = information.dwVolumeSerialNumber;
+    identity.fileIndex = (static_cast<ULONGLONG>(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+    links = information.nNumberOfLinks;
+    return true;
+}
+
+void CLinkTracker::AddRoot(const wstring& path)
+{
+    FileIdentity identity;
+    DWORD links;
+    if (bQueryIdentity(path, identity, links)) directories.Insert(identity);
+}
+
+bool CLinkTracker::bEnterDirectory(const wstring& path, DWORD attributes)
+{
+    FileIdentity identity;
+    return bEnterDirectory(path, attributes, identity);
+}
+
+bool CLinkTracker::bEnterDirectory(const wstring& path, DWORD attributes, FileIdentity& identity)
+{
+    // A followed link may lead to any directory, so every directory is identified and walked once
+    // under whichever path reaches it first; otherwise only junctions can lead back into the tree
+    identity = FileIdentity();
+    if (!followLinks && !(attributes & FILE_ATTRIBUTE_REPARSE_POINT)) return true;
+
+    DWORD links;
+    if (!bQueryIdentity(path, identity, links))
+    {
+        identity = FileIdentity();
+        return false;
+    }
+    return directories.Insert(identity);
+}
+
+bool CLinkTracker::bAcceptFile(const wstring& path, uint64_t& fileId)
+{
+    FileIdentity identity;
+    bool accepted = bAcceptFile(path, identity);
+    fileId = identity.fileIndex;
+    return accepted;
+}
+
+bool CLinkTracker::bAcceptFile(const wstring& path, FileIdentity& identity)
+{
+    identity = FileIdentity();
+    if (!dedupHardlinks) return true;
+
+    DWORD links;
+    if (!bQueryIdentity(path, identity, links))
+    {
+        identity = FileIdentity();
+        return true;
+    }
+
+    // Files with a single link cannot be reached twice, so they stay out of the set
+    return links < 2 || files.Insert(identity);
+}
@@ -0,0 +1,465 @@
+#include "QueryBench.h"
+#include "IndexPipeline.h"
+#include "LinkTracker.h"
+#include <psapi.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+wstring CQueryBench::Fold(const wstring& text)
+{
+    return FoldName(text);
+}
+
+bool CQueryBench::bMatches(const BenchQuery& query, const wchar_t* name, size_t length)
+{
+    const wstring& text = query.text;
+    switch (query.kind)
+    {
+    case QueryKind::Exact:
+    case QueryKind::Negative:
+        return length == text.size() && equal(text.begin(), text.end(), name);
+    case QueryKind::Prefix:
+        return length >= text.size() && equal(text.begin(), text.end(), name);
+    case QueryKind::Substring:
+        return search(name, name + length, text.begin(), text.end()) != name + length;
+    case QueryKind::Extension:
+        return length > text.size() && name[length - text.size() - 1] == L'.' && equal(text.begin(), text.end(), name + length - text.size());
+    default:
+        return false;
+    }
+}
+
+// Split a path at its last separator
+static void vSplitPath(const wstring& path, wstring& directory, wstring& name)
+{
+    size_t slash = path.find_last_of(L"\\/");
+    directory = (slash == wstring::npos) ? wstring() : path.substr(0, slash);
+    name = (slash == wstring::npos) ? path : path.substr(slash + 1);
+}
+
+void CHashQueryBackend::Build(const vector<wstring>& paths)
+{
+    index = CFlatHashIndex();
+
+    // Each distinct directory is stored once, under its full path
+    map<wstring, uint32_t> directories;
+    PolynomialHashKey hasher;
+    wstring directory, name;
+    for (const auto& path : paths)
+    {
+        vSplitPath(path, directory, name);
+        auto found = directories.find(directory);
+        if (found == directories.end())
+        {
+            found = directories.emplace(directory, index.AddDirectory(CFlatHashIndex::NO_DIRECTORY, directory.c_str(), directory.size())).first;
+        }
+
+        wstring folded = CQueryBench::Fold(name);
+        index.AddFile(found->second, folded.c_str(), folded.size(), hasher.Key(folded.c_str()));
+    }
+    index.Finalize();
+}
+
+size_t CHashQueryBackend::Run(const BenchQuery& query) const
+{
+    size_t matches = 0;
+    size_t length;
+
+    // Whole-name lookups probe one contiguous bucket run
+    if (query.kind == QueryKind::Exact || query.kind == QueryKind::Negative)
+    {
+        auto range = index.Find(PolynomialHashKey().Key(query.text.c_str()));
+        for (size_t entry = range.first; entry < range.second; entry++)
+        {
+            const wchar_t* name = index.Name(entry, length);
+            if (CQueryBench::bMatches(query, name, length)) matches++;
+        }
+        return matches;
+    }
+
+    // A hash cannot answer partial-name queries; scan the names in array order
+    for (size_t entry = 0; entry < index.size(); entry++)
+    {
+        const wchar_t* name = index.Name(entry, length);
+        if (CQueryBench::bMatches(query, name, length)) matches++;
+    }
+    return matches;
+}
+
+void CBtreeQueryBackend::Build(const vector<wstring>& paths)
+{
+    index = CSecondaryIndex();
+    wstring directory, name;
+    for (const auto& path : paths)
+    {
+        vSplitPath(path, directory, name);
+        index.Add(path, name);
+    }
+}
+
+size_t CBtreeQueryBackend::Run(const BenchQuery& query) const
+{
+    size_t matches = 0;
+    switch (query.kind)
+    {
+    case QueryKind::Exact:
+    case QueryKind::Negative:
+        // Equal names are the shortest keys of their prefix range, so stop at the first longer one
+        for (const auto& entry : index.NamesStartingWith(query.text))
+        {
+            if (entry.first.size() != query.text.size()) break;
+            matches++;
+        }
+        return matches;
+    case QueryKind::Prefix:
+    case QueryKind::Extension:
+    {
+        CSecondaryIndex::CRange range = (query.kind == QueryKind::Prefix) ? index.NamesStartingWith(query.text) : index.FilesWithExtension(query.text);
+        for (auto it = range.begin(); it != range.end(); it++) matches++;
+        return matches;
+    }
+    default:
+        // Substrings have no key order; scan the whole name index
+        for (const auto& entry : index.NamesStartingWith(L""))
+        {
+            if (CQueryBench::bMatches(query, entry.first.c_str(), entry.first.size())) matches++;
+        }
+        return matches;
+    }
+}
+
+void CBstQueryBackend::Build(const vector<wstring>& paths)
+{
+    tree = BinarySearchTree<CFoldedKey>();
+
+    // Names arrive in walk order, as the BST indexer inserts them; directory order is often sorted,
+    // so that tree degenerates towards a list, while the shuffled tree stays shallow
+    vector<wstring> names;
+    names.reserve(paths.size());
+    wstring directory, name;
+    for (const auto& path : paths)
+    {
+        vSplitPath(path, directory, name);
+        names.push_back(name);
+    }
+    if (shuffled) shuffle(names.begin(), names.end(), mt19937(1));
+
+    // Each key folds its name once here, so queries compare folded strings directly
+    for (auto& name : names)
+    {
+        tree.insert(CFoldedKey(move(name)));
+    }
+}
+
+size_t CBstQueryBackend::CountMatches(const BenchQuery& query, const wstring* low, const wstring* high) const
+{
+    size_t matches = 0;
+    vector<const CNode<CFoldedKey>*> stack;
+    if (tree.root != nullptr) stack.push_back(tree.root);
+
+    while (!stack.empty())
+    {
+        const CNode<CFoldedKey>* node = stack.back();
+        stack.pop_back();
+        const wstring& key = node->data.Folded();
+
+        bool aboveLow = (low == nullptr) || !(key < *low);
+        bool belowHigh = (high == nullptr) || key < *high;
+
+        if (aboveLow && belowHigh && CQueryBench::bMatches(query, key.c_str(), key.size())) matches++;
+
+        // Equal keys are inserted to the right, so the left subtree holds only smaller keys
+        if (node->left != nullptr && (low == nullptr || *low < key)) stack.push_back(node->left);
+        if (node->right != nullptr && belowHigh) stack.push_back(node->right);
+    }
+    return matches;
+}
+
+size_t CBstQueryBackend::Run(const BenchQuery& query) const
+{
+    switch (query.kind)
+    {
+    case QueryKind::Exact:
+    case QueryKind::Negative:
+    {
+        // The only keys in [name, name + L'\0') are the name itself
+        wstring high = query.text + wchar_t(0);
+        return CountMatches(query, &query.text, &high);
+    }
+    case QueryKind::Prefix:
+    {
+        wstring high(query.text);
+        while (!high.empty() && high.back() == WCHAR_MAX) high.pop_back();
+        if (high.empty()) return CountMatches(query, &query.text, nullptr);
+        high.back()++;
+        return CountMatches(query, &query.text, &high);
+    }
+    default:
+        return CountMatches(query, nullptr, nullptr);
+    }
+}
+
+size_t CScanQueryBackend::Run(const BenchQuery& query) const
+{
+    size_t matches = 0;
+    CLinkTracker links(filter != nullptr ? filter->Rules() : FilterRules());
+    links.AddRoot(root);
+    vector<pair<wstring, int>> pending;
+    pending.push_back({ root, 0 });
+
+    while (!pending.empty())
+    {
+        auto current = move(pending.back());
+        pending.pop_back();
+
+        WIN32_FIND_DATA findFileData;
+        wstring searchPath = current.first + L"\\*";
+        HANDLE hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+        if (hFind == INVALID_HANDLE_VALUE) continue;
+
+        do
+        {
+            // Ignore "." and ".." directories
+            if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (filter != nullptr && !filter->bAcceptDirectory(findFileData, current.second + 1)) continue;
+                wstring subdirectory = current.first + L"\\" + findFileData.cFileName;
+                if (links.bEnterDirectory(subdirectory, findFileData)) pending.push_back({ move(subdirectory), current.second + 1 });
+            }
+            else
+            {
+                if (filter != nullptr && !filter->bAcceptFile(findFileData)) continue;
+                uint64_t fileId;
+                if (!links.bAcceptFile(current.first + L"\\" + findFileData.cFileName, fileId)) continue;
+                wstring folded = CQueryBench::Fold(findFileData.cFileName);
+                if (CQueryBench::bMatches(query, folded.c_str(), folded.size())) matches++;
+            }
+        } while (FindNextFile(hFind, &findFileData) != 0);
+
+        FindClose(hFind);
+    }
+    return matches;
+}
+
+size_t CQueryBench::LoadTree(const wstring& root, const CIndexFilter* filter)
+{
+    paths.clear();
+    CLinkTracker links(filter != nullptr ? filter->Rules() : FilterRules());
+    links.AddRoot(root);
+    vector<pair<wstring, int>> pending;
+    pending.push_back({ root, 0 });
+
+    WIN32_FIND_DATA findFileData;
+    HANDLE hFind = FindFirstFile((root + L"\\*").c_str(), &findFileData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Invalid handle value. Directory not found or access denied.");
+    }
+    FindClose(hFind);
+
+    while (!pending.empty())
+    {
+        auto current = move(pending.back());
+        pending.pop_back();
+
+        wstring searchPath = current.first + L"\\*";
+        hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+        if (hFind == INVALID_HANDLE_VALUE) continue;
+
+        do
+        {
+            // Ignore "." and ".." directories
+            if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (filter != nullptr && !filter->bAcceptDirectory(findFileData, current.second + 1)) continue;
+                wstring subdirectory = current.first + L"\\" + findFileData.cFileName;
+                if (links.bEnterDirectory(subdirectory, findFileData)) pending.push_back({ move(subdirectory), current.second + 1 });
+            }
+            else
+            {
+                if (filter != nullptr && !filter->bAcceptFile(findFileData)) continue;
+                wstring filePath = current.first + L"\\" + findFileData.cFileName;
+                uint64_t fileId;
+                if (!links.bAcceptFile(filePath, fileId)) continue;
+                paths.push_back(move(filePath));
+            }
+        } while (FindNextFile(hFind, &findFileData) != 0);
+
+        FindClose(hFind);
+    }
+    return paths.size();
+}
+
+void CQueryBench::SynthesizeQueries()
+{
+    queries.clear();
+    if (paths.empty()) return;
+
+    mt19937 random(config.seed);
+    const QueryMix& mix = config.mix;
+    discrete_distribution<int> pickKind({ double(mix.exact), double(mix.prefix), double(mix.substring), double(mix.extension), double(mix.negative) });
+    uniform_int_distribution<size_t> pickPath(0, paths.size() - 1);
+
+    wstring directory, name;
+    for (size_t i = 0; i < config.queryCount; i++)
+    {
+        vSplitPath(paths[pickPath(random)], directory, name);
+        name = Fold(name);
+
+        BenchQuery query{ static_cast<QueryKind>(pickKind(random)), wstring() };
+        switch (query.kind)
+        {
+        case QueryKind::Exact:
+            query.text = name;
+            break;
+        case QueryKind::Prefix:
+            query.text = name.substr(0, min<size_t>(3, name.size()));
+            break;
+        case QueryKind::Substring:
+            query.text = name.substr(name.size() / 2, min<size_t>(3, name.size() - name.size() / 2));
+            break;
+        case QueryKind::Extension:
+        {
+            // Names without an extension become exact lookups
+            size_t dot = name.find_last_of(L'.');
+            if (dot == wstring::npos || dot + 1 == name.size())
+            {
+                query.kind = QueryKind::Exact;
+                query.text = name;
+            }
+            else
+            {
+                query.text = name.substr(dot + 1);
+            }
+            break;
+        }
+        default:
+            // '|' cannot appear in a Windows file name, so this never matches
+            query.text = name + L"|";
+            break;
+        }
+        queries.push_back(query);
+    }
+}
+
+void CQueryBench::LoadQueries(const wstring& path)
+{
+    FILE* file = _wfopen(path.c_str(), L"r, ccs=UTF-8");
+    if (file == nullptr)
+    {
+        throw runtime_error("Cannot open the query file.");
+    }
+
+    static const map<wstring, QueryKind> kinds = {
+        { L"exact", QueryKind::Exact }, { L"prefix", QueryKind::Prefix }, { L"substring", QueryKind::Substring },
+        { L"ext", QueryKind::Extension }, { L"negative", QueryKind::Negative } };
+
+    queries.clear();
+    wchar_t buffer[1024];
+    while (fgetws(buffer, 1024, file) != nullptr)
+    {
+        wstring line(buffer);
+        while (!line.empty() && (line.back() == L'\n' || line.back() == L'\r')) line.pop_back();
+
+        size_t tab = line.find(L'\t');
+        if (tab == wstring::npos) continue;
+
+        auto kind = kinds.find(line.substr(0, tab));
+        if (kind == kinds.end()) continue;
+
+        wstring text = Fold(line.substr(tab + 1));
+        if (kind->second == QueryKind::Extension && !text.empty() && text[0] == L'.') text.erase(0, 1);
+        queries.push_back({ kind->second, text });
+    }
+    fclose(file);
+
+    if (queries.empty())
+    {
+        throw runtime_error("The query file contains no queries.");
+    }
+}
+
+size_t CQueryBench::PrivateBytes()
+{
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    counters.cb = sizeof(counters);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) return 0;
+    return counters.PrivateUsage;
+}
+
+BenchResult CQueryBench::Run(CQueryBackend& backend)
+{
+    if (queries.empty()) SynthesizeQueries();
+
+    BenchResult result;
+    result.backend = backend.Name();
+
+    size_t before = PrivateBytes();
+    backend.Build(paths);
+    size_t after = PrivateBytes();
+    result.memoryBytes = (after > before) ? after - before : 0;
+
+    // Recorded lists shorter than the run are replayed from the start
+    const size_t total = max(config.queryCount, size_t(1));
+    const unsigned threadCount = max(config.threads, 1u);
+    vector<vector<double>> latencies(threadCount);
+    atomic<size_t> next(0);
+    atomic<size_t> matches(0);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threadCount; t++)
+    {
+        workers.emplace_back([&, t]()
+            {
+                vector<double>& samples = latencies[t];
+                samples.reserve(total / threadCount + 1);
+                size_t found = 0;
+                for (size_t i = next++; i < total; i = next++)
+                {
+                    auto queryStart = chrono::steady_clock::now();
+                    found += backend.Run(queries[i % queries.size()]);
+                    samples.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - queryStart).count());
+                }
+                matches += found;
+            });
+    }
+    for (auto& worker : workers) worker.join();
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    all.reserve(total);
+    for (const auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    sort(all.begin(), all.end());
+
+    auto percentile = [&](double p) { return all.empty() ? 0.0 : all[min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+    result.queries = all.size();
+    result.matches = matches;
+    result.queriesPerSecond = (result.seconds > 0) ? result.queries / result.seconds : 0;
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+void CQueryBench::PrintResults(const vector<BenchResult>& results)
+{
+    printf("%-12s %10s %12s %10s %10s %10s %12s %10s\n", "index", "queries", "queries/s", "p50 us", "p99 us", "p999 us", "memory KB", "matches");
+    for (const auto& result : results)
+    {
+        printf("%-12s %10zu %12.0f %10.2f %10.2f %10.2f %12zu %10zu\n", result.backend.c_str(), result.queries, result.queriesPerSecond,
+            result.p50, result.p99, result.p999, result.memoryBytes / 1024, result.matches);
+    }
+}
@@ -0,0 +1,63 @@
+#include "SecondaryIndex.h"
+#include "NameKey.h"
+#include <algorithm>
+
+// Windows paths compare case-insensitively, so every key is stored folded: lower-cased and
+// composed, so NFC and NFD spellings of a name or path share a key
+wstring CSecondaryIndex::NormalizePath(const wstring& path)
+{
+    wstring normalized;
+    normalized.reserve(path.size());
+    for (auto c : path)
+    {
+        if (c == L'/') c = L'\\';
+        if (c == L'\\' && !normalized.empty() && normalized.back() == L'\\') continue;
+        normalized.push_back(c);
+    }
+    while (normalized.size() > 1 && normalized.back() == L'\\') normalized.pop_back();
+    return FoldName(normalized);
+}
+
+void CSecondaryIndex::Add(const wstring& filePath, const wstring& fileName)
+{
+    uint32_t fileId = static_cast<uint32_t>(paths.size());
+    paths.push_back(filePath);
+
+    wstring name = FoldName(fileName);
+    byPath.insert(make_pair(NormalizePath(filePath), fileId));
+    byReversedName.insert(make_pair(wstring(name.rbegin(), name.rend()), fileId));
+    byName.insert(make_pair(name, fileId));
+}
+
+// Every key starting with the prefix lies in [prefix, successor of prefix)
+CSecondaryIndex::CRange CSecondaryIndex::PrefixRange(const KeyIndex& index, const wstring& prefix)
+{
+    auto first = index.lower_bound(prefix);
+
+    // The successor is the prefix with its last incrementable character bumped
+    wstring upper(prefix);
+    while (!upper.empty() && upper.back() == WCHAR_MAX) upper.pop_back();
+    if (upper.empty()) return CRange(first, index.end());
+    upper.back()++;
+
+    return CRange(first, index.lower_bound(upper));
+}
+
+CSecondaryIndex::CRange CSecondaryIndex::FilesUnder(const wstring& directory) const
+{
+    wstring prefix = NormalizePath(directory);
+    if (prefix.empty() || prefix.back() != L'\\') prefix.push_back(L'\\');
+    return PrefixRange(byPath, prefix);
+}
+
+CSecondaryIndex::CRange CSecondaryIndex::FilesWithExtension(const wstring& extension) const
+{
+    wstring suffix = FoldName(extension);
+    if (suffix.empty() || suffix[0] != L'.') suffix.insert(suffix.begin(), L'.');
+    return PrefixRange(byReversedName, wstring(suffix.rbegin(), suffix.rend()));
+}
+
+CSecondaryIndex::CRange CSecondaryIndex::NamesStartingWith(const wstring& prefix) const
+{
+    return PrefixRange(byName, FoldName(prefix));
+}
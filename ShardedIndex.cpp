@@ -0,0 +1,275 @@
+#include "ShardedIndex.h"
+#include "WorkerPool.h"
+#include "LinkTracker.h"
+#include <algorithm>
+#include <queue>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include "NameKey.h"
+
+CShardedIndex::~CShardedIndex()
+{
+    WaitAll();
+}
+
+size_t CShardedIndex::AddShard(const ShardConfig& config)
+{
+    shards.emplace_back(new Shard());
+    shards.back()->config = config;
+    return shards.size() - 1;
+}
+
+// Walk one root with the shard's own worker budget and return its records sorted by path
+shared_ptr<const CShardedIndex::Snapshot> CShardedIndex::BuildSnapshot(const ShardConfig& config)
+{
+    WIN32_FIND_DATA findFileData;
+    HANDLE hFind = FindFirstFile((config.root + L"\\*").c_str(), &findFileData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Invalid handle value. Directory not found or access denied.");
+    }
+    FindClose(hFind);
+
+    auto snapshot = make_shared<Snapshot>();
+    vector<IndexRecord>* records = &snapshot->records;
+    mutex recordsMutex;
+    CWorkerPool pool(config.workers, PinMode::None, false);
+
+    // Junctions are always checked for cycles; the rules decide whether links are followed and hard links merged
+    CLinkTracker links(config.filter != nullptr ? config.filter->Rules() : FilterRules());
+    links.AddRoot(config.root);
+
+    function<void(const wstring&, int)> enumerate = [&](const wstring& directory, int depth)
+        {
+            WIN32_FIND_DATA findFileData;
+            HANDLE hFind = FindFirstFile((directory + L"\\*").c_str(), &findFileData);
+            if (hFind == INVALID_HANDLE_VALUE) return;
+
+            // Collect the directory locally and take the shared lock once
+            vector<IndexRecord> found;
+            do
+            {
+                // Ignore "." and ".." directories
+                if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    if (config.filter != nullptr && !config.filter->bAcceptDirectory(findFileData, depth + 1)) continue;
+
+                    wstring subdirectory = directory + L"\\" + findFileData.cFileName;
+                    if (!links.bEnterDirectory(subdirectory, findFileData)) continue;
+                    pool.Submit([&enumerate, subdirectory, depth]() { enumerate(subdirectory, depth + 1); });
+                }
+                else if (config.filter == nullptr || config.filter->bAcceptFile(findFileData))
+                {
+                    // Skip further hard links to a file already indexed
+                    wstring filePath = directory + L"\\" + findFileData.cFileName;
+                    uint64_t fileId;
+                    if (!links.bAcceptFile(filePath, fileId)) continue;
+
+                    IndexRecord record = IndexRecord::FromFindData(filePath, findFileData, 0);
+                    record.fileId = fileId;
+                    found.push_back(move(record));
+                }
+            } while (FindNextFile(hFind, &findFileData) != 0);
+
+            FindClose(hFind);
+
+            lock_guard<mutex> lock(recordsMutex);
+            records->insert(records->end(), make_move_iterator(found.begin()), make_move_iterator(found.end()));
+        };
+
+    pool.Submit([&]() { enumerate(config.root, 0); });
+    pool.WaitIdle();
+
+    sort(records->begin(), records->end());
+
+    if (!config.indexPath.empty())
+    {
+        CIndexFileWriter writer(config.indexPath);
+        for (const auto& record : *records)
+        {
+            writer.Write(record);
+        }
+        writer.Close();
+    }
+
+    vFoldNames(*snapshot);
+    return snapshot;
+}
+
+void CShardedIndex::vFoldNames(Snapshot& snapshot)
+{
+    snapshot.foldedNames.clear();
+    snapshot.foldedNames.reserve(snapshot.records.size());
+    for (const auto& record : snapshot.records)
+    {
+        size_t separator = record.path.find_last_of(L"\\/");
+        size_t start = (separator == wstring::npos) ? 0 : separator + 1;
+        snapshot.foldedNames.push_back(FoldName(record.path.c_str() + start, record.path.size() - start));
+    }
+}
+
+bool CShardedIndex::Rebuild(size_t shardNumber)
+{
+    Shard& shard = *shards.at(shardNumber);
+    {
+        lock_guard<mutex> lock(shard.shardMutex);
+        if (shard.state == ShardState::Building) return false;
+        shard.state = ShardState::Building;
+    }
+
+    // The previous builder has finished, so joining it does not block
+    if (shard.builder.joinable()) shard.builder.join();
+
+    shard.builder = thread([this, &shard, shardNumber]()
+        {
+            ShardState state = ShardState::Ready;
+            try
+            {
+                shared_ptr<const Snapshot> snapshot = BuildSnapshot(shard.config);
+                lock_guard<mutex> lock(shard.shardMutex);
+                shard.snapshot = snapshot;
+                shard.state = state;
+            }
+            catch (const exception& e)
+            {
+                wcerr << L"Shard " << shard.config.root << L" failed: " << e.what() << endl;
+                state = ShardState::Failed;
+                lock_guard<mutex> lock(shard.shardMutex);
+                shard.state = state;
+            }
+
+            // Report from the builder so a slow shard does not delay the others' reports
+            if (onCompleted) onCompleted(shardNumber, state);
+        });
+    return true;
+}
+
+void CShardedIndex::BuildAll()
+{
+    for (size_t shard = 0; shard < shards.size(); shard++)
+    {
+        Rebuild(shard);
+    }
+}
+
+bool CShardedIndex::Load(size_t shardNumber)
+{
+    Shard& shard = *shards.at(shardNumber);
+    if (shard.config.indexPath.empty()) return false;
+
+    try
+    {
+        auto snapshot = make_shared<Snapshot>();
+        CIndexFileReader reader(shard.config.indexPath);
+        IndexRecord record;
+        while (reader.Read(record))
+        {
+            snapshot->records.push_back(move(record));
+        }
+        vFoldNames(*snapshot);
+
+        lock_guard<mutex> lock(shard.shardMutex);
+        shard.snapshot = snapshot;
+        if (shard.state != ShardState::Building) shard.state = ShardState::Ready;
+        return true;
+    }
+    catch (const runtime_error&)
+    {
+        return false;
+    }
+}
+
+void CShardedIndex::Wait(size_t shardNumber)
+{
+    Shard& shard = *shards.at(shardNumber);
+    if (shard.builder.joinable()) shard.builder.join();
+}
+
+void CShardedIndex::WaitAll()
+{
+    for (size_t shard = 0; shard < shards.size(); shard++)
+    {
+        Wait(shard);
+    }
+}
+
+ShardState CShardedIndex::State(size_t shardNumber) const
+{
+    const Shard& shard = *shards.at(shardNumber);
+    lock_guard<mutex> lock(shard.shardMutex);
+    return shard.state;
+}
+
+shared_ptr<const CShardedIndex::Snapshot> CShardedIndex::CurrentSnapshot(size_t shardNumber) const
+{
+    const Shard& shard = *shards[shardNumber];
+    lock_guard<mutex> lock(shard.shardMutex);
+    return shard.snapshot;
+}
+
+vector<IndexRecord> CShardedIndex::Query(const function<bool(const IndexRecord&)>& predicate, size_t limit) const
+{
+    return Scatter([&predicate](const Snapshot& snapshot, size_t position) { return predicate(snapshot.records[position]); }, limit);
+}
+
+vector<IndexRecord> CShardedIndex::Scatter(const function<bool(const Snapshot&, size_t)>& predicate, size_t limit) const
+{
+    // Scatter: each shard filters its own snapshot, which is already in path order; shards still
+    // building their first snapshot are skipped
+    vector<future<vector<IndexRecord>>> partials;
+    for (size_t shard = 0; shard < shards.size(); shard++)
+    {
+        shared_ptr<const Snapshot> snapshot = CurrentSnapshot(shard);
+        if (!snapshot) continue;
+
+        partials.push_back(async(launch::async, [snapshot, &predicate, limit]()
+            {
+                vector<IndexRecord> matches;
+                for (size_t position = 0; position < snapshot->records.size(); position++)
+                {
+                    if (!predicate(*snapshot, position)) continue;
+                    matches.push_back(snapshot->records[position]);
+                    if (limit != 0 && matches.size() == limit) break;
+                }
+                return matches;
+            }));
+    }
+
+    vector<vector<IndexRecord>> results;
+    for (auto& partial : partials)
+    {
+        results.push_back(partial.get());
+    }
+
+    // Gather: k-way merge of the sorted partial results
+    typedef pair<size_t, size_t> Cursor; // (result list, position)
+    auto greater = [&results](const Cursor& a, const Cursor& b) { return results[b.first][b.second] < results[a.first][a.second]; };
+    priority_queue<Cursor, vector<Cursor>, decltype(greater)> heap(greater);
+    for (size_t list = 0; list < results.size(); list++)
+    {
+        if (!results[list].empty()) heap.push({ list, 0 });
+    }
+
+    vector<IndexRecord> merged;
+    while (!heap.empty() && (limit == 0 || merged.size() < limit))
+    {
+        Cursor cursor = heap.top();
+        heap.pop();
+        merged.push_back(move(results[cursor.first][cursor.second]));
+        if (++cursor.second < results[cursor.first].size()) heap.push(cursor);
+    }
+    return merged;
+}
+
+vector<IndexRecord> CShardedIndex::FindByName(const wstring& text, size_t limit) const
+{
+    wstring needle = FoldName(text);
+
+    return Scatter([&needle](const Snapshot& snapshot, size_t position)
+        {
+            return snapshot.foldedNames[position].find(needle) != wstring::npos;
+        }, limit);
+}
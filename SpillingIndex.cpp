@@ -0,0 +1,176 @@
+#include "SpillingIndex.h"
+#include <algorithm>
+#include <queue>
+#include <memory>
+#include <stdexcept>
+
+CSpillingIndexBuilder::CSpillingIndexBuilder(size_t memoryBudget, const wstring& tempDirectory)
+    : memoryBudget(memoryBudget), tempDirectory(tempDirectory)
+{
+    // The record array takes at most a quarter of the budget and is allocated once, so runs
+    // fill it without regrowing and the rest of the budget is left for the path strings
+    buffer.reserve(max<size_t>(1, memoryBudget / 4 / sizeof(IndexRecord)));
+
+    if (this->tempDirectory.empty())
+    {
+        wchar_t tempPath[MAX_PATH + 1];
+        DWORD length = GetTempPath(MAX_PATH + 1, tempPath);
+        this->tempDirectory = (length == 0) ? L"." : wstring(tempPath, length);
+    }
+}
+
+CSpillingIndexBuilder::~CSpillingIndexBuilder()
+{
+    RemoveRuns();
+}
+
+// Approximate heap footprint of a buffered record's path; the record itself lives in the reserved array
+size_t CSpillingIndexBuilder::RecordBytes(const IndexRecord& record)
+{
+    return (record.path.capacity() + 1) * sizeof(wchar_t);
+}
+
+void CSpillingIndexBuilder::Add(IndexRecord&& record)
+{
+    lock_guard<mutex> lock(builderMutex);
+
+    bufferBytes += RecordBytes(record);
+    buffer.push_back(move(record));
+
+    // The reserved array counts against the budget in full; a full array is flushed rather than regrown
+    if (buffer.size() == buffer.capacity() || MemoryUsed() > memoryBudget)
+    {
+        FlushRun();
+    }
+}
+
+wstring CSpillingIndexBuilder::NewTempFile()
+{
+    wchar_t tempFile[MAX_PATH + 1];
+    if (GetTempFileName(tempDirectory.c_str(), L"fix", 0, tempFile) == 0)
+    {
+        throw runtime_error("Cannot create a temporary file for an index run");
+    }
+    return tempFile;
+}
+
+// Sort the buffered records and write them out as one run
+void CSpillingIndexBuilder::FlushRun()
+{
+    if (buffer.empty()) return;
+
+    sort(buffer.begin(), buffer.end());
+
+    wstring runFile = NewTempFile();
+    runFiles.push_back(runFile);
+
+    CIndexFileWriter writer(runFile);
+    for (const auto& record : buffer)
+    {
+        writer.Write(record);
+    }
+    writer.Close();
+
+    // Keep the reserved array for the next run
+    buffer.clear();
+    bufferBytes = 0;
+}
+
+// Temporary files that are deleted when the owner goes out of scope, so a merge pass that throws
+// does not leave its partial outputs behind; the builder's own runFiles are removed by its destructor
+struct CTempFiles
+{
+    vector<wstring> files;
+
+    ~CTempFiles()
+    {
+        for (const auto& file : files) DeleteFile(file.c_str());
+    }
+};
+
+// K-way merge of sorted runs (and optionally the in-memory run) into one sorted file
+void CSpillingIndexBuilder::MergeRuns(const vector<wstring>& inputs, vector<IndexRecord>* memoryRun, const wstring& outputPath)
+{
+    vector<unique_ptr<CIndexFileReader>> readers;
+    for (const auto& input : inputs)
+    {
+        readers.emplace_back(new CIndexFileReader(input));
+    }
+
+    // Heap entries are (record, source); the in-memory run uses source == readers.size()
+    typedef pair<IndexRecord, size_t> HeapEntry;
+    auto greater = [](const HeapEntry& a, const HeapEntry& b) { return b.first < a.first; };
+    priority_queue<HeapEntry, vector<HeapEntry>, decltype(greater)> heap(greater);
+
+    size_t memoryPosition = 0;
+    auto refill = [&](size_t source)
+        {
+            IndexRecord record;
+            if (source < readers.size())
+            {
+                if (readers[source]->Read(record)) heap.push({ move(record), source });
+            }
+            else if (memoryRun != nullptr && memoryPosition < memoryRun->size())
+            {
+                heap.push({ move((*memoryRun)[memoryPosition++]), source });
+            }
+        };
+
+    for (size_t source = 0; source <= readers.size(); source++)
+    {
+        refill(source);
+    }
+
+    CIndexFileWriter writer(outputPath);
+    while (!heap.empty())
+    {
+        size_t source = heap.top().second;
+        writer.Write(heap.top().first);
+        heap.pop();
+        refill(source);
+    }
+    writer.Close();
+}
+
+void CSpillingIndexBuilder::Finish(const wstring& outputPath)
+{
+    lock_guard<mutex> lock(builderMutex);
+
+    // Merge in bounded passes until the remaining runs fit in a single merge
+    while (runFiles.size() >= MAX_MERGE_FAN_IN)
+    {
+        CTempFiles merged;
+        for (size_t first = 0; first < runFiles.size(); first += MAX_MERGE_FAN_IN)
+        {
+            size_t last = min(first + MAX_MERGE_FAN_IN, runFiles.size());
+            vector<wstring> group(runFiles.begin() + first, runFiles.begin() + last);
+
+            wstring output = NewTempFile();
+            merged.files.push_back(output);
+            MergeRuns(group, nullptr, output);
+
+            for (const auto& run : group) DeleteFile(run.c_str());
+        }
+
+        // The merged runs become the builder's; the runs they replace are already deleted
+        runFiles.swap(merged.files);
+        merged.files.clear();
+    }
+
+    // The last run never touches disk before the final merge
+    sort(buffer.begin(), buffer.end());
+    MergeRuns(runFiles, &buffer, outputPath);
+
+    vector<IndexRecord>().swap(buffer);
+    bufferBytes = 0;
+    RemoveRuns();
+}
+
+void CSpillingIndexBuilder::RemoveRuns()
+{
+    for (const auto& run : runFiles)
+    {
+        DeleteFile(run.c_str());
+    }
+    runFiles.clear();
+}
@@ -0,0 +1,436 @@
+#include "SubtreeFilter.h"
+#include <algorithm>
+#include <stdexcept>
+#include "NameKey.h"
+#include <cstring>
+#include <io.h>
+
+// murmur3 finalizer
+uint64_t CXorFilter::Mix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint8_t Fingerprint(uint64_t hash)
+{
+    return static_cast<uint8_t>(hash ^ (hash >> 32));
+}
+
+// One slot in each of the three blocks
+void CXorFilter::Slots(uint64_t hash, uint32_t slots[3]) const
+{
+    slots[0] = Reduce(static_cast<uint32_t>(hash), blockLength);
+    slots[1] = Reduce(static_cast<uint32_t>(RotateLeft(hash, 21)), blockLength) + blockLength;
+    slots[2] = Reduce(static_cast<uint32_t>(RotateLeft(hash, 42)), blockLength) + 2 * blockLength;
+}
+
+void CXorFilter::Build(vector<uint64_t> keys)
+{
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    fingerprints.clear();
+    blockLength = 0;
+    if (keys.empty()) return;
+
+    blockLength = static_cast<uint32_t>((32 + 1.23 * keys.size()) / 3) + 1;
+    const uint32_t capacity = 3 * blockLength;
+
+    vector<uint32_t> counts(capacity);
+    vector<uint64_t> xorHashes(capacity);
+    vector<uint32_t> queue;
+    vector<pair<uint64_t, uint32_t>> stack; // (hash, slot it was peeled from)
+    queue.reserve(capacity);
+    stack.reserve(keys.size());
+
+    // Peeling fails with small probability; retry with a new seed
+    for (seed = 0x9e3779b97f4a7c15ull;; seed = Mix(seed + 1))
+    {
+        fill(counts.begin(), counts.end(), 0);
+        fill(xorHashes.begin(), xorHashes.end(), 0);
+        queue.clear();
+        stack.clear();
+
+        for (uint64_t key : keys)
+        {
+            uint64_t hash = Mix(key + seed);
+            uint32_t slots[3];
+            Slots(hash, slots);
+            for (uint32_t slot : slots)
+            {
+                counts[slot]++;
+                xorHashes[slot] ^= hash;
+            }
+        }
+
+        for (uint32_t slot = 0; slot < capacity; slot++)
+        {
+            if (counts[slot] == 1) queue.push_back(slot);
+        }
+
+        // Repeatedly remove keys that are alone in one of their slots
+        while (!queue.empty())
+        {
+            uint32_t slot = queue.back();
+            queue.pop_back();
+            if (counts[slot] != 1) continue;
+
+            uint64_t hash = xorHashes[slot];
+            stack.push_back({ hash, slot });
+
+            uint32_t slots[3];
+            Slots(hash, slots);
+            for (uint32_t other : slots)
+            {
+                counts[other]--;
+                xorHashes[other] ^= hash;
+                if (counts[other] == 1) queue.push_back(other);
+            }
+        }
+
+        if (stack.size() == keys.size()) break;
+    }
+
+    // Assign fingerprints in reverse peeling order so each key's three slots xor to its fingerprint
+    fingerprints.assign(capacity, 0);
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+    {
+        uint32_t slots[3];
+        Slots(it->first, slots);
+        fingerprints[it->second] = 0;
+        fingerprints[it->second] = Fingerprint(it->first) ^ fingerprints[slots[0]] ^ fingerprints[slots[1]] ^ fingerprints[slots[2]];
+    }
+}
+
+bool CXorFilter::Contains(uint64_t key) const
+{
+    if (blockLength == 0) return false;
+
+    uint64_t hash = Mix(key + seed);
+    uint32_t slots[3];
+    Slots(hash, slots);
+    return Fingerprint(hash) == (fingerprints[slots[0]] ^ fingerprints[slots[1]] ^ fingerprints[slots[2]]);
+}
+
+void CXorFilter::Save(FILE* file) const
+{
+    fwrite(&seed, sizeof(seed), 1, file);
+    fwrite(&blockLength, sizeof(blockLength), 1, file);
+    fwrite(fingerprints.data(), 1, fingerprints.size(), file);
+}
+
+bool CXorFilter::Load(FILE* file, uint64_t fileSize)
+{
+    if (fread(&seed, sizeof(seed), 1, file) != 1 || fread(&blockLength, sizeof(blockLength), 1, file) != 1) return false;
+    if (uint64_t(3) * blockLength > fileSize - uint64_t(_ftelli64(file))) return false;
+    fingerprints.resize(size_t(3) * blockLength);
+    return fread(fingerprints.data(), 1, fingerprints.size(), file) == fingerprints.size();
+}
+
+// Lookup key for a directory: separators unified, folded, no trailing separator
+static wstring DirectoryKey(const wstring& directory)
+{
+    wstring key(directory);
+    for (auto& c : key) if (c == L'/') c = L'\\';
+    while (key.size() > 1 && key.back() == L'\\') key.pop_back();
+    return FoldName(key);
+}
+
+// FNV-1a over the folded name, so case and NFC/NFD variants hash alike
+uint64_t CSubtreeFilterIndex::HashName(const wchar_t* name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : FoldName(name, wcslen(name)))
+    {
+        hash ^= static_cast<uint64_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void CSubtreeFilterIndex::Build(const wstring& root, const CIndexFilter* filter)
+{
+    WIN32_FILE_ATTRIBUTE_DATA rootData;
+    if (!GetFileAttributesEx(root.c_str(), GetFileExInfoStandard, &rootData) || !(rootData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        throw runtime_error("Invalid handle value. Directory not found or access denied.");
+    }
+
+    // Junctions are always checked for cycles; the rules decide whether links are followed and hard links merged
+    CLinkTracker links(filter != nullptr ? filter->Rules() : FilterRules());
+    links.AddRoot(root);
+
+    // Walk the tree with its own listings, then build the filters the way an indexing walk would
+    CSubtreeFilterBuilder builder(root);
+    vector<pair<wstring, int>> pending;
+    pending.push_back({ root, 0 });
+    while (!pending.empty())
+    {
+        auto current = move(pending.back());
+        pending.pop_back();
+
+        WIN32_FIND_DATA findFileData;
+        wstring searchPath = current.first + L"\\*";
+        HANDLE hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+
+        vector<uint64_t> fileHashes;
+        if (hFind != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                // Ignore "." and ".." directories
+                if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    if (filter == nullptr || filter->bAcceptDirectory(findFileData, current.second + 1))
+                    {
+                        wstring subdirectory = current.first + L"\\" + findFileData.cFileName;
+                        if (links.bEnterDirectory(subdirectory, findFileData)) pending.push_back({ move(subdirectory), current.second + 1 });
+                    }
+                }
+                else if (filter == nullptr || filter->bAcceptFile(findFileData))
+                {
+                    uint64_t fileId;
+                    if (!links.bAcceptFile(current.first + L"\\" + findFileData.cFileName, fileId)) continue;
+                    fileHashes.push_back(HashName(findFileData.cFileName));
+                }
+            } while (FindNextFile(hFind, &findFileData) != 0);
+
+            FindClose(hFind);
+        }
+        builder.AddDirectory(current.first, move(fileHashes));
+    }
+    builder.Finish(*this);
+}
+
+void CSubtreeFilterBuilder::AddDirectory(const wstring& path, vector<uint64_t> fileHashes)
+{
+    lock_guard<mutex> lock(builderMutex);
+    vector<uint64_t>& hashes = directories[path];
+    hashes.insert(hashes.end(), fileHashes.begin(), fileHashes.end());
+}
+
+void CSubtreeFilterBuilder::Finish(CSubtreeFilterIndex& index)
+{
+    lock_guard<mutex> lock(builderMutex);
+
+    // A directory the walk could not list still links its children to the root
+    vector<wstring> paths;
+    paths.reserve(directories.size() + 1);
+    directories.try_emplace(root);
+    for (const auto& entry : directories) paths.push_back(entry.first);
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if (paths[i] == root) continue;
+        size_t slash = paths[i].find_last_of(L'\\');
+        if (slash == wstring::npos || slash < root.size()) continue;
+        wstring parent = paths[i].substr(0, slash);
+        if (directories.try_emplace(parent).second) paths.push_back(move(parent));
+    }
+
+    // Number parents before children: the root first, then by depth below it
+    auto depthOf = [](const wstring& path) { return count(path.begin(), path.end(), L'\\'); };
+    sort(paths.begin(), paths.end(), [&](const wstring& left, const wstring& right)
+        {
+            if ((left == root) != (right == root)) return left == root;
+            ptrdiff_t leftDepth = depthOf(left), rightDepth = depthOf(right);
+            return leftDepth != rightDepth ? leftDepth < rightDepth : left < right;
+        });
+
+    index.nodes.clear();
+    index.nodeByPath.clear();
+    unordered_map<wstring, uint32_t> ids;
+    for (auto& path : paths)
+    {
+        // Directories outside the root cannot be reached by a lookup
+        if (path != root && (path.compare(0, root.size(), root) != 0 || path.size() <= root.size() || path[root.size()] != L'\\')) continue;
+
+        uint32_t nodeId = static_cast<uint32_t>(index.nodes.size());
+        index.nodes.push_back(CSubtreeFilterIndex::Node());
+        CSubtreeFilterIndex::Node& node = index.nodes.back();
+        node.path = path;
+        node.fileHashes = move(directories[path]);
+        sort(node.fileHashes.begin(), node.fileHashes.end());
+        ids[path] = nodeId;
+        if (nodeId != 0) index.nodes[ids[path.substr(0, path.find_last_of(L'\\'))]].children.push_back(nodeId);
+    }
+    directories.clear();
+
+    // Bottom-up: children have higher ids, so each subtree's hashes are complete when its node is reached
+    vector<vector<uint64_t>> subtreeHashes(index.nodes.size());
+    for (size_t nodeId = index.nodes.size(); nodeId-- > 0;)
+    {
+        CSubtreeFilterIndex::Node& node = index.nodes[nodeId];
+        vector<uint64_t>& hashes = subtreeHashes[nodeId];
+        hashes.insert(hashes.end(), node.fileHashes.begin(), node.fileHashes.end());
+        for (uint32_t childId : node.children)
+        {
+            hashes.insert(hashes.end(), subtreeHashes[childId].begin(), subtreeHashes[childId].end());
+            vector<uint64_t>().swap(subtreeHashes[childId]);
+        }
+        node.subtree.Build(hashes);
+    }
+
+    for (uint32_t nodeId = 0; nodeId < index.nodes.size(); nodeId++)
+    {
+        index.nodeByPath[DirectoryKey(index.nodes[nodeId].path)] = nodeId;
+    }
+}
+
+int CSubtreeFilterIndex::Locate(const wstring& directory) const
+{
+    auto found = nodeByPath.find(DirectoryKey(directory));
+    return (found == nodeByPath.end()) ? -1 : static_cast<int>(found->second);
+}
+
+void CSubtreeFilterIndex::Collect(uint32_t nodeId, uint64_t hash, bool stopAtFirst, vector<wstring>& found) const
+{
+    const Node& node = nodes[nodeId];
+    if (!node.subtree.Contains(hash))
+    {
+        prunedSubtrees++;
+        return;
+    }
+
+    if (binary_search(node.fileHashes.begin(), node.fileHashes.end(), hash))
+    {
+        found.push_back(node.path);
+        if (stopAtFirst) return;
+    }
+
+    for (uint32_t childId : node.children)
+    {
+        Collect(childId, hash, stopAtFirst, found);
+        if (stopAtFirst && !found.empty()) return;
+    }
+}
+
+bool CSubtreeFilterIndex::Exists(const wstring& fileName, const wstring& underDirectory) const
+{
+    prunedSubtrees = 0;
+    int nodeId = Locate(underDirectory);
+    if (nodeId < 0) return false;
+
+    vector<wstring> found;
+    Collect(static_cast<uint32_t>(nodeId), HashName(fileName.c_str()), true, found);
+    return !found.empty();
+}
+
+vector<wstring> CSubtreeFilterIndex::Find(const wstring& fileName, const wstring& underDirectory) const
+{
+    prunedSubtrees = 0;
+    vector<wstring> found;
+    int nodeId = Locate(underDirectory);
+    if (nodeId >= 0) Collect(static_cast<uint32_t>(nodeId), HashName(fileName.c_str()), false, found);
+    return found;
+}
+
+// File layout: magic, node count, then per node its path, children, file hashes and filter; the
+// magic changed when names started hashing in folded form, so older files are rejected
+static const char FILTER_MAGIC[4] = { 'F', 'S', 'T', '2' };
+
+void CSubtreeFilterIndex::Save(const wstring& filePath) const
+{
+    FILE* file = _wfopen(filePath.c_str(), L"wb");
+    if (file == nullptr)
+    {
+        throw runtime_error("Cannot create subtree filter file");
+    }
+
+    uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+    fwrite(FILTER_MAGIC, 1, sizeof(FILTER_MAGIC), file);
+    fwrite(&nodeCount, sizeof(nodeCount), 1, file);
+    for (const auto& node : nodes)
+    {
+        uint32_t pathLength = static_cast<uint32_t>(node.path.size());
+        uint32_t childCount = static_cast<uint32_t>(node.children.size());
+        uint32_t hashCount = static_cast<uint32_t>(node.fileHashes.size());
+        fwrite(&pathLength, sizeof(pathLength), 1, file);
+        fwrite(node.path.data(), sizeof(wchar_t), pathLength, file);
+        fwrite(&childCount, sizeof(childCount), 1, file);
+        fwrite(node.children.data(), sizeof(uint32_t), childCount, file);
+        fwrite(&hashCount, sizeof(hashCount), 1, file);
+        fwrite(node.fileHashes.data(), sizeof(uint64_t), hashCount, file);
+        node.subtree.Save(file);
+    }
+
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+    {
+        throw runtime_error("Cannot write subtree filter file");
+    }
+}
+
+bool CSubtreeFilterIndex::Load(const wstring& filePath)
+{
+    FILE* file = _wfopen(filePath.c_str(), L"rb");
+    if (file == nullptr) return false;
+
+    // Sizes are checked against the bytes left, so a corrupt file cannot request a huge allocation
+    _fseeki64(file, 0, SEEK_END);
+    uint64_t fileSize = static_cast<uint64_t>(_ftelli64(file));
+    _fseeki64(file, 0, SEEK_SET);
+    auto fits = [&](uint64_t count, size_t elementSize) { return count * elementSize <= fileSize - uint64_t(_ftelli64(file)); };
+
+    char magic[4];
+    uint32_t nodeCount = 0;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, FILTER_MAGIC, sizeof(magic)) == 0 &&
+        fread(&nodeCount, sizeof(nodeCount), 1, file) == 1 && fits(nodeCount, 3 * sizeof(uint32_t));
+
+    vector<Node> loaded(ok ? nodeCount : 0);
+    vector<bool> hasParent(loaded.size());
+    for (uint32_t nodeId = 0; ok && nodeId < nodeCount; nodeId++)
+    {
+        Node& node = loaded[nodeId];
+        uint32_t pathLength = 0, childCount = 0, hashCount = 0;
+
+        ok = fread(&pathLength, sizeof(pathLength), 1, file) == 1 && pathLength <= 32767;
+        if (ok)
+        {
+            node.path.resize(pathLength);
+            ok = fread(&node.path[0], sizeof(wchar_t), pathLength, file) == pathLength && fread(&childCount, sizeof(childCount), 1, file) == 1 && childCount < nodeCount;
+        }
+        if (ok)
+        {
+            node.children.resize(childCount);
+            ok = fread(node.children.data(), sizeof(uint32_t), childCount, file) == childCount && fread(&hashCount, sizeof(hashCount), 1, file) == 1 &&
+                fits(hashCount, sizeof(uint64_t));
+        }
+        if (ok)
+        {
+            node.fileHashes.resize(hashCount);
+            ok = fread(node.fileHashes.data(), sizeof(uint64_t), hashCount, file) == hashCount && node.subtree.Load(file, fileSize);
+        }
+
+        // Build numbers children after their parent and gives each one parent; anything else could
+        // make the recursive lookups loop or revisit a subtree
+        for (uint32_t childId : node.children)
+        {
+            if (childId <= nodeId || childId >= nodeCount || hasParent[childId]) ok = false;
+            else hasParent[childId] = true;
+        }
+    }
+    fclose(file);
+
+    if (!ok) return false;
+
+    nodes.swap(loaded);
+    nodeByPath.clear();
+    for (uint32_t nodeId = 0; nodeId < nodes.size(); nodeId++)
+    {
+        nodeByPath[DirectoryKey(nodes[nodeId].path)] = nodeId;
+    }
+    return true;
+}
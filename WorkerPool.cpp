@@ -0,0 +1,236 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+// Node the current worker was placed on
+static thread_local unsigned currentNode = 0;
+
+unsigned CWorkerPool::CurrentNode()
+{
+    return currentNode;
+}
+
+// GetNumaNodeProcessorMask2 (Windows 10 20348 and later) reports every group of a node that spans
+// several; older systems only report the node's primary group through GetNumaNodeProcessorMaskEx
+typedef BOOL(WINAPI* NodeProcessorMask2)(USHORT, PGROUP_AFFINITY, USHORT, PUSHORT);
+
+vector<GROUP_AFFINITY> CWorkerPool::NodeAffinities(USHORT node)
+{
+    static const NodeProcessorMask2 nodeProcessorMask2 = reinterpret_cast<NodeProcessorMask2>(
+        GetProcAddress(GetModuleHandle(L"kernel32.dll"), "GetNumaNodeProcessorMask2"));
+
+    vector<GROUP_AFFINITY> affinities;
+    if (nodeProcessorMask2 != nullptr)
+    {
+        USHORT required = 0;
+        nodeProcessorMask2(node, nullptr, 0, &required);
+        affinities.resize(required);
+        if (required == 0 || !nodeProcessorMask2(node, affinities.data(), required, &required)) affinities.clear();
+    }
+
+    if (affinities.empty())
+    {
+        GROUP_AFFINITY affinity = {};
+        if (GetNumaNodeProcessorMaskEx(node, &affinity)) affinities.push_back(affinity);
+    }
+    return affinities;
+}
+
+vector<vector<CWorkerPool::ProcessorSlot>> CWorkerPool::DiscoverTopology(bool numaAware)
+{
+    vector<vector<ProcessorSlot>> nodes;
+
+    ULONG highestNode = 0;
+    if (GetNumaHighestNodeNumber(&highestNode))
+    {
+        for (ULONG node = 0; node <= highestNode; node++)
+        {
+            vector<ProcessorSlot> slots;
+            for (const auto& affinity : NodeAffinities(static_cast<USHORT>(node)))
+            {
+                for (BYTE bit = 0; bit < sizeof(affinity.Mask) * 8; bit++)
+                {
+                    if (affinity.Mask & (ULONG_PTR(1) << bit)) slots.push_back({ affinity.Group, bit });
+                }
+            }
+            if (!slots.empty()) nodes.push_back(slots);
+        }
+    }
+
+    // Without NUMA placement all processors form one node
+    if (!numaAware && nodes.size() > 1)
+    {
+        for (size_t node = 1; node < nodes.size(); node++)
+        {
+            nodes[0].insert(nodes[0].end(), nodes[node].begin(), nodes[node].end());
+        }
+        nodes.resize(1);
+    }
+
+    if (nodes.empty()) nodes.resize(1);
+    return nodes;
+}
+
+CWorkerPool::CWorkerPool(unsigned threadCount, PinMode pinMode, bool numaAware)
+{
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+
+    vector<vector<ProcessorSlot>> topology = DiscoverTopology(numaAware);
+    for (size_t node = 0; node < topology.size(); node++)
+    {
+        queues.emplace_back(new NodeQueue());
+    }
+
+    // Processor groups each node spans, in the order they were reported
+    vector<vector<WORD>> nodeGroups(topology.size());
+    for (size_t node = 0; node < topology.size(); node++)
+    {
+        for (const auto& slot : topology[node])
+        {
+            if (find(nodeGroups[node].begin(), nodeGroups[node].end(), slot.group) == nodeGroups[node].end()) nodeGroups[node].push_back(slot.group);
+        }
+    }
+
+    // Deal workers round-robin across nodes, then across the processors of each node
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        unsigned node = i % topology.size();
+        const vector<ProcessorSlot>& slots = topology[node];
+
+        GROUP_AFFINITY affinity = {};
+        bool pin = (pinMode != PinMode::None) && !slots.empty();
+        if (pin)
+        {
+            if (pinMode == PinMode::Core)
+            {
+                const ProcessorSlot& slot = slots[(i / topology.size()) % slots.size()];
+                affinity.Group = slot.group;
+                affinity.Mask = ULONG_PTR(1) << slot.number;
+            }
+            else
+            {
+                // A thread's affinity lies within one group, so a node's workers take its groups in turn
+                const vector<WORD>& groups = nodeGroups[node];
+                affinity.Group = groups[(i / topology.size()) % groups.size()];
+                for (const auto& slot : slots)
+                {
+                    if (slot.group == affinity.Group) affinity.Mask |= ULONG_PTR(1) << slot.number;
+                }
+            }
+        }
+
+        workers.emplace_back([this, node, pin, affinity]()
+            {
+                if (pin) SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+                currentNode = node;
+                WorkerLoop(node);
+            });
+    }
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    stopping = true;
+    for (auto& queue : queues)
+    {
+        // Taking the lock orders the notification after any wait that had already checked stopping
+        { lock_guard<mutex> lock(queue->queueMutex); }
+        queue->workAvailable.notify_all();
+    }
+
+    for (auto& worker : workers)
+    {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void CWorkerPool::Submit(unsigned node, function<void()> task)
+{
+    NodeQueue& queue = *queues[node % queues.size()];
+    pending++;
+    {
+        lock_guard<mutex> lock(queue.queueMutex);
+        queue.tasks.push_back(move(task));
+        queued++;
+    }
+    Wake(node % queues.size());
+}
+
+// Wake one sleeping worker, preferring the task's own node; a worker of another node steals the task
+void CWorkerPool::Wake(unsigned node)
+{
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        NodeQueue& queue = *queues[(node + i) % queues.size()];
+        if (queue.sleepers == 0) continue;
+
+        // A sleeper holds the lock from counting itself until it waits, so the notification cannot be missed
+        { lock_guard<mutex> lock(queue.queueMutex); }
+        queue.workAvailable.notify_one();
+        return;
+    }
+}
+
+// Take work from the worker's own node first and lock other nodes' queues only to steal when it is empty
+bool CWorkerPool::PopTask(unsigned node, function<void()>& task)
+{
+    for (size_t i = 0; i < queues.size() && queued > 0; i++)
+    {
+        NodeQueue& queue = *queues[(node + i) % queues.size()];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (!queue.tasks.empty())
+        {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CWorkerPool::WorkerLoop(unsigned node)
+{
+    NodeQueue& own = *queues[node];
+    while (!stopping)
+    {
+        function<void()> task;
+        if (!PopTask(node, task))
+        {
+            // Sleep on the own node's queue until a submitter anywhere wakes this worker
+            unique_lock<mutex> lock(own.queueMutex);
+            own.sleepers++;
+            own.workAvailable.wait(lock, [&]() { return stopping || queued > 0; });
+            own.sleepers--;
+            continue;
+        }
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(idleMutex);
+            if (!firstError) firstError = current_exception();
+        }
+
+        if (--pending == 0)
+        {
+            lock_guard<mutex> lock(idleMutex);
+            idle.notify_all();
+        }
+    }
+}
+
+void CWorkerPool::WaitIdle()
+{
+    unique_lock<mutex> lock(idleMutex);
+    idle.wait(lock, [&]() { return pending == 0; });
+
+    if (firstError)
+    {
+        exception_ptr error = firstError;
+        firstError = nullptr;
+        rethrow_exception(error);
+    }
+}
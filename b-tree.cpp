@@ -14,6 +14,34 @@ const char* DirectoryIndexingException::what() const noexcept
 // BtreeSearchIndexer implementation
 template <typename K, typename V>
 void BtreeSearchIndexer<K, V>::IndexDirectory(const std::wstring& directory, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex)
+{
+    // Subdirectories are queued on a bounded pool instead of getting a thread each
+    CWorkerPool workerPool(poolConfig.ioWorkers, poolConfig.numaAware ? PinMode::Node : PinMode::None, poolConfig.numaAware);
+    pool = &workerPool;
+
+    // Junctions are always checked for cycles; ordinary directories and files are opened only when
+    // the rules follow links or merge hard links
+    CLinkTracker tracker(filter != nullptr ? filter->Rules() : FilterRules());
+    tracker.AddRoot(directory);
+    links = &tracker;
+
+    try
+    {
+        workerPool.Submit(0, [&]() { IndexDirectoryAtDepth(directory, 0, fileCount, subdirectoryCount, fileIndex); });
+        workerPool.WaitIdle();
+    }
+    catch (...)
+    {
+        pool = nullptr;
+        links = nullptr;
+        throw;
+    }
+    pool = nullptr;
+    links = nullptr;
+}
+
+template <typename K, typename V>
+void BtreeSearchIndexer<K, V>::IndexDirectoryAtDepth(const std::wstring& directory, int depth, int& fileCount, int& subdirectoryCount, stx::btree_map<K, V>& fileIndex)
 {
     WIN32_FIND_DATA findFileData;
     HANDLE hFind = INVALID_HANDLE_VALUE;  // Initialize hFind to INVALID_HANDLE_VALUE
@@ -38,6 +66,9 @@ void BtreeSearchIndexer<K, V>::IndexDirectory(const std::wstring& directory, int
             // Vector to store subdirectory paths for multithreading
             std::vector<std::wstring> subdirectories;
 
+            // Hashes of the accepted file names for the subtree filters
+            std::vector<uint64_t> fileHashes;
+
             do
             {
                 // Ignore "." and ".." directories
@@ -50,14 +81,26 @@ void BtreeSearchIndexer<K, V>::IndexDirectory(const std::wstring& directory, int
                 // Check if the file is a directory
                 if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                 {
-                    // Add subdirectory to the list for multithreading
+                    // Prune excluded subtrees before their path is built
+                    if (filter != nullptr && !filter->bAcceptDirectory(findFileData, depth + 1))
+                    {
+                        continue;
+                    }
+
+                    // Add subdirectory to the list for multithreading, unless it is a link to a directory already walked
                     std::wstring subdirectory = directory + L"\\" + findFileData.cFileName;
+                    if (!links->bEnterDirectory(subdirectory, findFileData))
+                    {
+                        continue;
+                    }
                     subdirectories.push_back(subdirectory);
                 }
                 else
                 {
-                    // Increment file count
-                    fileCount++;
+                    if (filter != nullptr && !filter->bAcceptFile(findFileData))
+                    {
+                        continue;
+                    }
 
                     // Generate a simple hash code for the file by summing the Unicode code point values of each character in the file name
                     std::wstring fileName = std::wstring(findFileData.cFileName);
@@ -69,8 +112,41 @@ void BtreeSearchIndexer<K, V>::IndexDirectory(const std::wstring& directory, int
 
                     // Add the file to the index using the hash code as the key
                     std::wstring filePath = directory + L"\\" + findFileData.cFileName;
+
+                    // Skip further hard links to a file already indexed
+                    uint64_t fileId = 0;
+                    if (!links->bAcceptFile(filePath, fileId))
+                    {
+                        continue;
+                    }
+                    if (filterBuilder != nullptr)
+                    {
+                        fileHashes.push_back(CSubtreeFilterIndex::HashName(findFileData.cFileName));
+                    }
+
+                    // Under a memory budget the builder owns the records and spills them as needed;
+                    // the secondary indexes are still filled so directory, extension and name queries answer
+                    if (spillBuilder != nullptr)
+                    {
+                        IndexRecord record = IndexRecord::FromFindData(filePath, findFileData, static_cast<uint64_t>(hashCode));
+                        record.fileId = fileId;
+                        spillBuilder->Add(std::move(record));
+                        std::lock_guard<std::mutex> lock(mtx1);
+                        fileCount++;
+                        if (secondaryIndex != nullptr)
+                        {
+                            secondaryIndex->Add(filePath, fileName);
+                        }
+                        continue;
+                    }
+
                     std::lock_guard<std::mutex> lock(mtx1); // Lock mutex for thread-safe access
+                    fileCount++;
                     fileIndex[std::to_string(hashCode)] = filePath;
+                    if (secondaryIndex != nullptr)
+                    {
+                        secondaryIndex->Add(filePath, fileName);
+                    }
                 }
 
             } while (FindNextFile(hFind, &findFileData) != 0); // Keep searching until no more files or directories are found
@@ -84,18 +160,22 @@ void BtreeSearchIndexer<K, V>::IndexDirectory(const std::wstring& directory, int
             // Close the handle to the file search
             FindClose(hFind);
 
-            // Create threads for indexing subdirectories
-            std::vector<std::thread> threads;
-            for (const auto& subdirectory : subdirectories)
+            if (filterBuilder != nullptr)
             {
-                subdirectoryCount++;
-                threads.emplace_back(&BtreeSearchIndexer::IndexDirectory, this, subdirectory, std::ref(fileCount), std::ref(subdirectoryCount), std::ref(fileIndex));
+                filterBuilder->AddDirectory(directory, std::move(fileHashes));
             }
 
-            // Wait for all threads to complete
-            for (auto& t : threads)
+            // Queue the subdirectories on the worker pool
+            for (const auto& subdirectory : subdirectories)
             {
-                t.join();
+                {
+                    std::lock_guard<std::mutex> lock(mtx1);
+                    subdirectoryCount++;
+                }
+                pool->Submit([this, subdirectory, depth, &fileCount, &subdirectoryCount, &fileIndex]()
+                    {
+                        IndexDirectoryAtDepth(subdirectory, depth + 1, fileCount, subdirectoryCount, fileIndex);
+                    });
             }
         }
     }
@@ -10,10 +10,22 @@ using namespace std;
 
 mutex mtx;
 
-void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearchTree<wstring>& bst)
+void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearchTree<CFoldedKey>& bst, const CIndexFilter* filter, int depth, CSpillingIndexBuilder* spillBuilder,
+    CSubtreeFilterBuilder* filterBuilder, CLinkTracker* links)
 {
+    // Junctions are always checked for cycles; ordinary directories and files are opened only when
+    // the rules follow links or merge hard links
+    if (links == nullptr)
+    {
+        CLinkTracker tracker(filter != nullptr ? filter->Rules() : FilterRules());
+        tracker.AddRoot(directory);
+        vListFilesInDirectory(directory, fileCount, bst, filter, depth, spillBuilder, filterBuilder, &tracker);
+        return;
+    }
+
     WIN32_FIND_DATA findFileData;
     HANDLE hFind;
+    vector<uint64_t> fileHashes;
 
     wstring searchPath = directory + L"\\*";
     hFind = FindFirstFile(searchPath.c_str(), &findFileData);
@@ -32,15 +44,47 @@ void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearc
 
                 if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                 {
+                    if (filter != nullptr && !filter->bAcceptDirectory(findFileData, depth + 1))
+                    {
+                        continue;
+                    }
+
+                    // Skip links to a directory already walked
                     wstring subdirectory = directory + L"\\" + findFileData.cFileName;
+                    if (!links->bEnterDirectory(subdirectory, findFileData))
+                    {
+                        continue;
+                    }
 
-                    thread t([&subdirectory, &fileCount, &bst]() {
-                        vListFilesInDirectory(subdirectory, fileCount, bst);
+                    thread t([&subdirectory, &fileCount, &bst, filter, depth, spillBuilder, filterBuilder, links]() {
+                        vListFilesInDirectory(subdirectory, fileCount, bst, filter, depth + 1, spillBuilder, filterBuilder, links);
                         });
                     t.join();
                 }
-                else
+                else if (filter == nullptr || filter->bAcceptFile(findFileData))
                 {
+                    // Skip further hard links to a file already indexed
+                    uint64_t fileId;
+                    if (!links->bAcceptFile(directory + L"\\" + findFileData.cFileName, fileId))
+                    {
+                        continue;
+                    }
+                    if (filterBuilder != nullptr)
+                    {
+                        fileHashes.push_back(CSubtreeFilterIndex::HashName(findFileData.cFileName));
+                    }
+
+                    if (spillBuilder != nullptr)
+                    {
+                        // Spilled runs are merged in path order, the same order the tree yields
+                        IndexRecord record = IndexRecord::FromFindData(directory + L"\\" + findFileData.cFileName, findFileData, 0);
+                        record.fileId = fileId;
+                        spillBuilder->Add(move(record));
+                        lock_guard<mutex> lock(mtx);
+                        fileCount++;
+                        continue;
+                    }
+
                     lock_guard<mutex> lock(mtx);
                     fileCount++;
                     bst.insert(directory + L"\\" + findFileData.cFileName);
@@ -58,4 +102,9 @@ void vListFilesInDirectory(const wstring& directory, int& fileCount, BinarySearc
 
         FindClose(hFind);
     }
+
+    if (filterBuilder != nullptr)
+    {
+        filterBuilder->AddDirectory(directory, move(fileHashes));
+    }
 }
\ No newline at end of file
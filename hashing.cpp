@@ -1,135 +1,396 @@
 #include "hashing.h"
 
-// Hash function that returns an index for a given filename
+// Hash function that returns an index for a given filename; the folded name is hashed so
+// case and composed/decomposed variants of a name share a bucket
 template <typename T>
 size_t CHashing<T>::hash_filename(const T& filename)
 {
-    const size_t p = 31; // A prime number used in the hash function
-    const size_t m = 1e9 + 9; // A large prime number used in the hash function
-    size_t hash_value = 0;
-    size_t p_pow = 1;
-    for (auto c : filename)
+    return PolynomialNameHash(filename.c_str(), filename.size());
+}
+
+// Receives a walk into per-node map shards that are merged into the caller's map
+template <typename T>
+struct CMapSink
+{
+    struct Shard
+    {
+        mutex shard_mutex;
+        map<size_t, vector<T>> index;
+    };
+
+    vector<Shard> shards;
+
+    void Prepare(size_t nodes) { shards = vector<Shard>(nodes); }
+
+    // The map stores full paths, so directories need no id
+    uint32_t AddDirectory(uint32_t, const T&, const wchar_t*) { return 0; }
+
+    void AddFiles(size_t node, uint32_t, const T& directory, const vector<WIN32_FIND_DATA>& batch, const vector<size_t>& keys)
     {
-        hash_value = (hash_value + (size_t(c) * p_pow) % m) % m; // The hash function
-        p_pow = (p_pow * p) % m;
+        Shard& shard = shards[node % shards.size()];
+        lock_guard<mutex> lock(shard.shard_mutex);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            shard.index[keys[i]].push_back(directory + L"\\" + batch[i].cFileName);
+        }
     }
-    return hash_value;
-}
+
+    void Merge(map<size_t, vector<T>>& index)
+    {
+        for (auto& shard : shards)
+        {
+            for (auto& entry : shard.index)
+            {
+                vector<T>& bucket = index[entry.first];
+                bucket.insert(bucket.end(), make_move_iterator(entry.second.begin()), make_move_iterator(entry.second.end()));
+            }
+        }
+    }
+};
+
+// Receives a walk into per-node flat shards; directories go straight into the caller's index
+template <typename T>
+struct CFlatSink
+{
+    struct Shard
+    {
+        mutex shard_mutex;
+        CFlatHashIndex files;
+    };
+
+    CFlatHashIndex& index;
+    mutex directory_mutex;
+    vector<Shard> shards;
+
+    explicit CFlatSink(CFlatHashIndex& index) : index(index) {}
+
+    void Prepare(size_t nodes) { shards = vector<Shard>(nodes); }
+
+    // The root is stored under its full path, every other directory under its own name
+    uint32_t AddDirectory(uint32_t parent, const T& path, const wchar_t* name)
+    {
+        lock_guard<mutex> lock(directory_mutex);
+        if (parent == CFlatHashIndex::NO_DIRECTORY) return index.AddDirectory(parent, path.c_str(), path.size());
+        return index.AddDirectory(parent, name, wcslen(name));
+    }
+
+    void AddFiles(size_t node, uint32_t directory, const T&, const vector<WIN32_FIND_DATA>& batch, const vector<size_t>& keys)
+    {
+        Shard& shard = shards[node % shards.size()];
+        lock_guard<mutex> lock(shard.shard_mutex);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            shard.files.AddFile(directory, batch[i].cFileName, wcslen(batch[i].cFileName), keys[i]);
+        }
+    }
+
+    void Merge()
+    {
+        // Size the index to the shard totals once, so appending each shard never reallocates
+        size_t files = index.size(), nameCharacters = index.NameCharacters();
+        for (auto& shard : shards)
+        {
+            files += shard.files.size();
+            nameCharacters += shard.files.NameCharacters();
+        }
+        index.Reserve(files, nameCharacters);
+
+        for (auto& shard : shards)
+        {
+            index.AppendFiles(shard.files);
+        }
+        index.Finalize();
+    }
+};
 
 // Function to list files in a directory, hash their names, and store them in the index
 template <typename T>
 void CHashing<T>::vListFilesInDirectoryH(const T& directory, map<size_t, vector<T>>& index, int& file_count)
+{
+    try
+    {
+        CMapSink<T> sink;
+        vWalk(directory, sink, file_count);
+        sink.Merge(index);
+    }
+    catch (const runtime_error& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+    }
+    catch (...)
+    {
+        cerr << "An unknown error occurred while listing files in the directory." << endl;
+    }
+}
+
+// Function to list files in a directory, hash their names, and store them in the flat index
+template <typename T>
+bool CHashing<T>::vListFilesInDirectoryH(const T& directory, CFlatHashIndex& index, int& file_count)
+{
+    try
+    {
+        CFlatSink<T> sink(index);
+        vWalk(directory, sink, file_count);
+        sink.Merge();
+        return true;
+    }
+    catch (const runtime_error& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+    }
+    catch (...)
+    {
+        cerr << "An unknown error occurred while listing files in the directory." << endl;
+    }
+    return false;
+}
+
+// Walk the tree on the I/O and CPU pools and hand each directory's hashed files to the sink
+template <typename T>
+template <typename Sink>
+void CHashing<T>::vWalk(const T& directory, Sink& sink, int& file_count)
 {
     WIN32_FIND_DATA findFileData;
     HANDLE hFind;
 
-    try
+    // Search for all files and directories in the given directory
+    T searchPath = directory + L"\\*";
+    hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Invalid handle value. Directory not found or access denied.");
+    }
+
+    FindClose(hFind);
+
+    // Enumeration waits on the file system, hashing and insertion on the CPU, so each gets its own pool
+    CWorkerPool ioPool(poolConfig.ioWorkers, poolConfig.numaAware ? PinMode::Node : PinMode::None, poolConfig.numaAware);
+    CWorkerPool cpuPool(poolConfig.cpuWorkers, poolConfig.pinToCores ? PinMode::Core : (poolConfig.numaAware ? PinMode::Node : PinMode::None), poolConfig.numaAware);
+
+    // Enumerations run under the throttle's priority, rate and concurrency limits
+    CIoThrottle throttle(throttleConfig, ioPool.WorkerCount());
+
+    // Junctions are always checked for cycles; ordinary directories and files are opened only when
+    // the rules follow links or merge hard links
+    CLinkTracker links(filter != nullptr ? filter->Rules() : FilterRules());
+    links.AddRoot(directory);
+
+    // One directory's accepted files; an identity is zero unless the tracker opened the file
+    struct FileBatch
     {
-        // Search for all files and directories in the given directory
-        T searchPath = directory + L"\\*";
-        hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+        vector<WIN32_FIND_DATA> files;
+        vector<FileIdentity> identities;
+    };
 
-        if (hFind == INVALID_HANDLE_VALUE)
+    // One sink shard per NUMA node so workers never write to another node's memory
+    sink.Prepare(cpuPool.NodeCount());
+    atomic<int> indexed(0);
+
+    // Hash one directory's files and pass them to the shard of the node running the task
+    auto hash_batch = [&](uint32_t directory_id, const T& current_directory, const FileBatch& batch)
         {
-            throw runtime_error("Invalid handle value. Directory not found or access denied.");
-        }
+            CIoThrottle::CPriorityScope priority(throttle);
 
-        // Queue to manage directories for multi-threading
-        queue<T> directories;
-        directories.push(directory);
-
-        // Vector to hold threads
-        vector<thread> threads;
-        // Mutex for thread-safe access to shared resources
-        mutex index_mutex;
-        // Condition variable for thread synchronization
-        condition_variable cv;
-        // Flag to indicate if all directories are processed
-        bool done = false;
-
-        // Lambda function to be run by each thread
-        auto worker = [&]()
+            vector<size_t> keys;
+            keys.reserve(batch.files.size());
+            for (size_t i = 0; i < batch.files.size(); i++)
             {
-                while (true)
+                const WIN32_FIND_DATA& fileData = batch.files[i];
+
+                // Hash filename to get the index key
+                keys.push_back(hash_filename(fileData.cFileName));
+
+                // Under a memory budget the builder owns the records and spills them as needed
+                if (spillBuilder != nullptr)
                 {
-                    T current_directory;
+                    T file_path = current_directory + L"\\" + fileData.cFileName;
+                    IndexRecord record = IndexRecord::FromFindData(file_path, fileData, keys.back());
+                    record.fileId = batch.identities[i].fileIndex;
+                    spillBuilder->Add(move(record));
+                }
+            }
 
-                    // Lock mutex and wait for work
+            if (spillBuilder == nullptr)
+            {
+                sink.AddFiles(CWorkerPool::CurrentNode(), directory_id, current_directory, batch.files, keys);
+            }
+            indexed += static_cast<int>(batch.files.size());
+        };
+
+    // Enumerate one directory: subdirectories become I/O tasks, files one CPU task on the same node
+    function<void(const T&, uint32_t, int)> enumerate = [&](const T& current_directory, uint32_t directory_id, int current_depth)
+        {
+            auto batch = make_shared<FileBatch>();
+            vector<pair<T, uint32_t>> subdirectories;
+            vector<FileIdentity> subdirectory_identities;
+            {
+                // Hold a throttle slot while reading the directory; only the Find* calls are timed for the latency target
+                CIoThrottle::CSlot slot(throttle);
+
+                // Each task owns its own search handle and find data
+                WIN32_FIND_DATA findFileData;
+                T searchPath = current_directory + L"\\*";
+                HANDLE hFind = slot.Timed([&]() { return FindFirstFile(searchPath.c_str(), &findFileData); });
+
+                if (hFind == INVALID_HANDLE_VALUE) return;
+
+                do
+                {
+                    // Ignore "." and ".." directories
+                    if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+                    // Check if the file is a directory
+                    if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                     {
-                        unique_lock<mutex> lock(index_mutex);
-                        cv.wait(lock, [&]() { return !directories.empty() || done; });
+                        // Prune excluded subtrees before their path is built
+                        if (filter != nullptr && !filter->bAcceptDirectory(findFileData, current_depth + 1)) continue;
 
-                        // If done and no more directories, exit the thread
-                        if (done && directories.empty()) return;
+                        // Queue the subdirectory on this worker's node, unless it is a link to a directory already walked
+                        T subdirectory = current_directory + L"\\" + findFileData.cFileName;
+                        FileIdentity identity;
+                        if (!links.bEnterDirectory(subdirectory, findFileData.dwFileAttributes, identity)) continue;
+                        uint32_t subdirectory_id = sink.AddDirectory(directory_id, subdirectory, findFileData.cFileName);
+                        subdirectories.push_back({ move(subdirectory), subdirectory_id });
+                        subdirectory_identities.push_back(identity);
+                    }
+                    else
+                    {
+                        if (filter != nullptr && !filter->bAcceptFile(findFileData)) continue;
 
-                        // Get the next directory to process
-                        current_directory = directories.front();
-                        directories.pop();
+                        // Skip further hard links to a file already indexed
+                        FileIdentity identity;
+                        if (!links.bAcceptFile(current_directory + L"\\" + findFileData.cFileName, identity)) continue;
+                        batch->identities.push_back(identity);
+                        batch->files.push_back(findFileData);
                     }
+                } while (slot.Timed([&]() { return FindNextFile(hFind, &findFileData); }) != 0);
 
-                    T searchPath = current_directory + L"\\*";
-                    hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+                FindClose(hFind);
+            }
 
-                    if (hFind == INVALID_HANDLE_VALUE) continue;
+            // The listing also feeds the subtree filters, so they need no walk of their own
+            if (filterBuilder != nullptr)
+            {
+                vector<uint64_t> fileHashes;
+                fileHashes.reserve(batch->files.size());
+                for (const auto& fileData : batch->files) fileHashes.push_back(CSubtreeFilterIndex::HashName(fileData.cFileName));
+                filterBuilder->AddDirectory(current_directory, move(fileHashes));
+            }
 
-                    do
-                    {
-                        // Ignore "." and ".." directories
-                        if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
-
-                        // Check if the file is a directory
-                        if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-                        {
-                            // Add subdirectory to the queue
-                            T subdirectory = current_directory + L"\\" + findFileData.cFileName;
-                            {
-                                lock_guard<mutex> lock(index_mutex);
-                                directories.push(subdirectory);
-                            }
-                            cv.notify_one(); // Notify one waiting thread
-                        }
-                        else
-                        {
-                            // Hash filename to get the index key
-                            size_t index_key = hash_filename(findFileData.cFileName);
-                            T file_path = current_directory + L"\\" + findFileData.cFileName;
-                            {
-                                lock_guard<mutex> lock(index_mutex);
-                                index[index_key].push_back(file_path);
-                                file_count++;
-                            }
-                        }
-                    } while (FindNextFile(hFind, &findFileData) != 0);
-
-                    FindClose(hFind);
+            // Journal the directory before queueing its subdirectories, so a parent's record always precedes its children's;
+            // the identities the tracker recorded go with it so a resumed walk skips the same links
+            if (journal != nullptr)
+            {
+                JournalDirectory completed;
+                completed.path = current_directory;
+                for (size_t i = 0; i < batch->files.size(); i++)
+                {
+                    const WIN32_FIND_DATA& fileData = batch->files[i];
+                    unsigned long long size = (static_cast<unsigned long long>(fileData.nFileSizeHigh) << 32) | fileData.nFileSizeLow;
+                    unsigned long long lastWriteTime = (static_cast<unsigned long long>(fileData.ftLastWriteTime.dwHighDateTime) << 32) | fileData.ftLastWriteTime.dwLowDateTime;
+                    completed.files.push_back({ fileData.cFileName, size, lastWriteTime, batch->identities[i] });
+                }
+                for (const auto& subdirectory : subdirectories)
+                {
+                    completed.subdirectories.push_back(subdirectory.first.substr(current_directory.size() + 1));
                 }
-            };
+                completed.subdirectoryIdentities = move(subdirectory_identities);
+                journal->Append(completed);
+            }
+
+            for (const auto& subdirectory : subdirectories)
+            {
+                T path = subdirectory.first;
+                uint32_t subdirectory_id = subdirectory.second;
+                ioPool.Submit([&enumerate, path, subdirectory_id, current_depth]() { enumerate(path, subdirectory_id, current_depth + 1); });
+            }
+
+            if (!batch->files.empty())
+            {
+                cpuPool.Submit(CWorkerPool::CurrentNode(), [&hash_batch, directory_id, current_directory, batch]() { hash_batch(directory_id, current_directory, *batch); });
+            }
+        };
 
-        // Determine the number of threads to use
-        int num_threads = thread::hardware_concurrency();
-        for (int i = 0; i < num_threads; ++i)
+    uint32_t root_id = sink.AddDirectory(CFlatHashIndex::NO_DIRECTORY, directory, directory.c_str());
+
+    // Enumeration finishes first; after that no new hashing tasks can appear
+    // Hashing tasks must drain even when enumeration failed, since they reference the sink
+    try
+    {
+        if (journal == nullptr)
         {
-            threads.emplace_back(worker);
+            ioPool.Submit(0, [&]() { enumerate(directory, root_id, 0); });
         }
-
-        // Join all threads to wait for their completion
-        for (auto& t : threads)
+        else
         {
-            if (t.joinable()) t.join();
+            // Replay the journaled directories into the sink and the link tracker, then walk only what they left unfinished
+            unordered_map<T, uint32_t> directory_ids;
+            directory_ids[directory] = root_id;
+            vector<PendingDirectory> pending = journal->Recover([&](const JournalDirectory& recovered)
+                {
+                    auto found = directory_ids.find(recovered.path);
+                    if (found == directory_ids.end()) return;
+                    uint32_t recovered_id = found->second;
+
+                    for (size_t i = 0; i < recovered.subdirectories.size(); i++)
+                    {
+                        const T& name = recovered.subdirectories[i];
+                        T subdirectory = recovered.path + L"\\" + name;
+                        directory_ids[subdirectory] = sink.AddDirectory(recovered_id, subdirectory, name.c_str());
+                        links.AddDirectory(recovered.subdirectoryIdentities[i]);
+                    }
+
+                    if (filterBuilder != nullptr)
+                    {
+                        vector<uint64_t> fileHashes;
+                        fileHashes.reserve(recovered.files.size());
+                        for (const auto& entry : recovered.files) fileHashes.push_back(CSubtreeFilterIndex::HashName(entry.name.c_str()));
+                        filterBuilder->AddDirectory(recovered.path, move(fileHashes));
+                    }
+
+                    auto batch = make_shared<FileBatch>();
+                    for (const auto& entry : recovered.files)
+                    {
+                        links.AddFile(entry.identity);
+                        batch->identities.push_back(entry.identity);
+
+                        WIN32_FIND_DATA fileData = {};
+                        wcsncpy_s(fileData.cFileName, MAX_PATH, entry.name.c_str(), _TRUNCATE);
+                        fileData.nFileSizeHigh = static_cast<DWORD>(entry.size >> 32);
+                        fileData.nFileSizeLow = static_cast<DWORD>(entry.size);
+                        fileData.ftLastWriteTime.dwHighDateTime = static_cast<DWORD>(entry.lastWriteTime >> 32);
+                        fileData.ftLastWriteTime.dwLowDateTime = static_cast<DWORD>(entry.lastWriteTime);
+                        batch->files.push_back(fileData);
+                    }
+                    if (!batch->files.empty())
+                    {
+                        T recovered_path = recovered.path;
+                        cpuPool.Submit(0, [&hash_batch, recovered_id, recovered_path, batch]() { hash_batch(recovered_id, recovered_path, *batch); });
+                    }
+                });
+
+            for (const auto& directory_to_walk : pending)
+            {
+                auto found = directory_ids.find(directory_to_walk.path);
+                if (found == directory_ids.end()) continue;
+                T path = directory_to_walk.path;
+                uint32_t pending_id = found->second;
+                int depth = directory_to_walk.depth;
+                ioPool.Submit(0, [&enumerate, path, pending_id, depth]() { enumerate(path, pending_id, depth); });
+            }
         }
 
-        // Indicate that all work is done and notify all threads
-        done = true;
-        cv.notify_all();
-    }
-    catch (const runtime_error& e)
-    {
-        cerr << "Error: " << e.what() << endl;
+        ioPool.WaitIdle();
     }
     catch (...)
     {
-        cerr << "An unknown error occurred while listing files in the directory." << endl;
+        cpuPool.WaitIdle();
+        throw;
     }
+    cpuPool.WaitIdle();
+
+    file_count += indexed;
 }
 
 // Function to print the indexed files
@@ -149,6 +410,26 @@ void CHashing<T>::print_index(const map<size_t, vector<T>>& index, int file_coun
     }
 }
 
+// Function to print the flat index, walking its arrays in hash order
+template <typename T>
+void CHashing<T>::print_index(const CFlatHashIndex& index, int file_count)
+{
+    cout << "Indexed " << file_count << " files." << endl;
+
+    // One path buffer reused for every entry
+    wstring path;
+    for (size_t entry = 0; entry < index.size(); entry++)
+    {
+        if (entry == 0 || index.Hash(entry) != index.Hash(entry - 1))
+        {
+            cout << "Index key " << index.Hash(entry) << " : " << endl;
+        }
+        path.clear();
+        index.AppendPath(entry, path);
+        wcout << "  " << path << endl;
+    }
+}
+
 // Explicit template instantiation
 //template class CHashing<wstring>;
 //
@@ -5,9 +5,19 @@
 #include <unordered_map> // Provides an unordered associative container
 #include <map>           // Provides map container
 #include <vector>        // Provides vector container
+#include <memory>        // Provides smart pointers
 #include <Windows.h>     // Provides Windows-specific functions and data types
 #include "binarysearchtree.h"
 #include "DirectoryIndexer.h"
+#include "IndexFilter.h"
+#include "SecondaryIndex.h"
+#include "SpillingIndex.h"
+#include "SubtreeFilter.h"
+#include "IndexDiff.h"
+#include "IndexPipeline.h"
+#include "ShardedIndex.h"
+#include "LazyIndex.h"
+#include "QueryBench.h"
 
 // Include the source files for the B-Tree, hashing, and search algorithms
 //#include "C:\\Users\\msi Katana\\source\\repos\\OS_P\\b-tree.cpp"
@@ -16,11 +26,51 @@
 //#include "C:\\Users\\msi Katana\\source\\repos\\OS_P\\binarysearchtree.cpp"
 
 // This is the main function of the program.
+// Parse a whole number typed at a prompt; stoull would also take signs and trailing text
+static bool bParseCount(const std::wstring& text, size_t& value)
+{
+    if (text.empty() || text.find_first_not_of(L"0123456789") != std::wstring::npos)
+    {
+        return false;
+    }
+    try
+    {
+        value = static_cast<size_t>(std::stoull(text));
+        return true;
+    }
+    catch (const std::out_of_range&)
+    {
+        return false;
+    }
+}
+
+// Parse a positive decimal rate typed at a prompt; signs, exponents and trailing text are rejected
+static bool bParseRate(const std::wstring& text, double& value)
+{
+    if (text.empty() || text.find_first_not_of(L"0123456789.") != std::wstring::npos || text.find(L'.') != text.rfind(L'.') ||
+        text.find_first_of(L"0123456789") == std::wstring::npos)
+    {
+        return false;
+    }
+    try
+    {
+        value = std::stod(text);
+    }
+    catch (const std::out_of_range&)
+    {
+        return false;
+    }
+    return value > 0;
+}
+
 int main()
 {
     // Prompt the user to choose between indexing or searching.
     std::cout << "Press 1 for indexing" << std::endl;
     std::cout << "Press 2 for searching" << std::endl;
+    std::cout << "Press 3 for comparing two index files" << std::endl;
+    std::cout << "Press 4 for indexing and searching several roots" << std::endl;
+    std::cout << "Press 5 for profiling index queries" << std::endl;
     // Read user input for choice
     int choice1;
     std::cin >> choice1;
@@ -37,6 +87,22 @@ int main()
         // Read directory path from user
         std::getline(std::wcin, directory);
 
+        // Ask user for optional gitignore-style exclusion patterns
+        std::wstring excludeList;
+        std::cout << "Enter patterns to exclude separated by ';' (e.g. .git/;node_modules/;*.tmp), or leave blank: ";
+        std::getline(std::wcin, excludeList);
+
+        // Compile the rules once so the walkers can prune subtrees cheaply
+        FilterRules rules;
+        rules.excludePatterns = vSplitPatterns(excludeList);
+
+        // Ask user whether to follow directory symbolic links; links are otherwise skipped to avoid cycles
+        std::wstring linksAnswer;
+        std::cout << "Follow directory symbolic links and index hard-linked files once? (y/n, blank for no): ";
+        std::getline(std::wcin, linksAnswer);
+        rules.followLinks = rules.dedupHardlinks = (!linksAnswer.empty() && (linksAnswer[0] == L'y' || linksAnswer[0] == L'Y'));
+        CIndexFilter filter(rules);
+
         // Declare variables for file and subdirectory count
         int fileCount = 0;
         int subdirectoryCount = 0;
@@ -47,22 +113,81 @@ int main()
         std::cout << "Press 1 for indexing using binary tree" << std::endl;
         std::cout << "Press 2 for indexing using btree-search" << std::endl;
         std::cout << "Press 3 for indexing using hashing" << std::endl;
+        std::cout << "Press 4 for indexing using the compiled single-threaded pipeline" << std::endl;
+        std::cout << "Press 5 for lazy on-demand indexing" << std::endl;
         // Switch statement to choose indexing method
         std::cin >> choice;
 
+        // Ignore the newline left after the choice so the prompts below read whole lines
+        std::cin.ignore();
+
+        // Ask user for an optional memory budget; above it the index is spilled to disk.
+        // Only the binary tree, btree-search and hashing indexers can spill
+        std::wstring indexPath;
+        std::unique_ptr<CSpillingIndexBuilder> spillBuilder;
+        if (choice >= 1 && choice <= 3)
+        {
+            size_t budgetMB = 0;
+            while (true)
+            {
+                std::wstring budgetText;
+                std::cout << "Enter memory budget in MB (0 or blank for unlimited): ";
+                std::getline(std::wcin, budgetText);
+                if (budgetText.empty())
+                {
+                    break;
+                }
+
+                if (bParseCount(budgetText, budgetMB))
+                {
+                    break;
+                }
+                std::cout << "Enter a whole number of megabytes" << std::endl;
+            }
+
+            // With a budget the index is written to a persisted file instead of being printed
+            if (budgetMB > 0)
+            {
+                std::cout << "Enter path of the index file to write: ";
+                std::getline(std::wcin, indexPath);
+                spillBuilder.reset(new CSpillingIndexBuilder(budgetMB << 20));
+            }
+        }
+
+        // Ask user for an optional subtree filter file; exact name lookups load it instead of walking the tree.
+        // The filters are collected from the indexing walk itself, so only the walking methods offer it
+        std::wstring filterPath;
+        std::unique_ptr<CSubtreeFilterBuilder> filterBuilder;
+        if (choice >= 1 && choice <= 3)
+        {
+            std::cout << "Enter a subtree filter file to write for name lookups (blank for none): ";
+            std::getline(std::wcin, filterPath);
+            if (!filterPath.empty())
+            {
+                filterBuilder.reset(new CSubtreeFilterBuilder(directory));
+            }
+        }
+
         switch (choice)
         {
             // If user chooses binary search indexing
         case 1:
         {
             // Create a binary search tree object
-            BinarySearchTree<std::wstring> bst;
+            BinarySearchTree<CFoldedKey> bst;
 
             // Record start time for indexing
             auto start = std::chrono::high_resolution_clock::now();
 
             // Index files in the directory using binary tree method
-            vListFilesInDirectory(directory, fileCount, bst);
+            vListFilesInDirectory(directory, fileCount, bst, &filter, 0, spillBuilder.get(), filterBuilder.get());
+
+            // Merge the spilled runs into the persisted index and keep its fuzzy name index beside it
+            if (spillBuilder)
+            {
+                spillBuilder->Finish(indexPath);
+                CFuzzyNameIndex::WriteSidecar(indexPath);
+            }
 
             // Record end time for indexing
             auto end = std::chrono::high_resolution_clock::now();
@@ -71,7 +196,14 @@ int main()
             auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
             // Print the indexed files using inorder traversal of the binary tree
-            bst.traverse();
+            if (spillBuilder)
+            {
+                std::wcout << L"Index written to " << indexPath << std::endl;
+            }
+            else
+            {
+                bst.traverse();
+            }
 
             // Print file count and indexing duration
             std::cout << "Total files: " << fileCount << std::endl;
@@ -84,9 +216,16 @@ int main()
         {
             // Create a new instance of the BtreeSearchIndexer class
             BtreeSearchIndexer<std::string, std::wstring> indexer;
+            indexer.SetFilter(&filter);
+
+            // Secondary indexes for directory, extension and name-prefix queries
+            CSecondaryIndex secondaryIndex;
+            indexer.SetSecondaryIndex(&secondaryIndex);
+            indexer.SetSpillBuilder(spillBuilder.get());
+            indexer.SetFilterBuilder(filterBuilder.get());
 
             // Declare variables to hold the index statistics
-            std::unordered_map<std::string, std::wstring> fileIndex;
+            stx::btree_map<std::string, std::wstring> fileIndex;
 
             // Start the timer
             auto start = std::chrono::high_resolution_clock::now();
@@ -94,6 +233,14 @@ int main()
             // Index the directory and its subdirectories using the BtreeSearchIndexer class
             indexer.IndexDirectory(directory, fileCount, subdirectoryCount, fileIndex);
 
+            // Merge the spilled runs into the persisted index and keep its fuzzy name index beside it
+            if (spillBuilder)
+            {
+                spillBuilder->Finish(indexPath);
+                CFuzzyNameIndex::WriteSidecar(indexPath);
+                std::wcout << L"Index written to " << indexPath << std::endl;
+            }
+
             // Stop the timer
             auto stop = std::chrono::high_resolution_clock::now();
 
@@ -113,6 +260,36 @@ int main()
             // Print the time taken to index the files
             std::cout << "Time taken to index files: " << duration << " nanoseconds" << std::endl;
 
+            // Answer range queries against the secondary indexes until a blank line is entered
+            std::wstring query;
+            while (true)
+            {
+                std::cout << "Enter a query (under:<dir>, ext:<extension>, name:<prefix>) or leave blank to finish: ";
+                if (!std::getline(std::wcin, query) || query.empty())
+                {
+                    break;
+                }
+
+                size_t colon = query.find(L':');
+                std::wstring kind = query.substr(0, colon);
+                std::wstring argument = (colon == std::wstring::npos) ? L"" : query.substr(colon + 1);
+
+                if (kind != L"under" && kind != L"ext" && kind != L"name")
+                {
+                    std::cout << "Enter a valid query" << std::endl;
+                    continue;
+                }
+
+                CSecondaryIndex::CRange range = (kind == L"under") ? secondaryIndex.FilesUnder(argument)
+                    : (kind == L"ext") ? secondaryIndex.FilesWithExtension(argument)
+                    : secondaryIndex.NamesStartingWith(argument);
+
+                for (const auto& entry : range)
+                {
+                    std::wcout << L"  " << secondaryIndex.Path(entry) << std::endl;
+                }
+            }
+
             break;
         }
         // If user chooses hashing-search indexing
@@ -120,16 +297,77 @@ int main()
         {
             // Create a Hasing object
             CHashing<std::wstring> hashing;
-            std::map<size_t, std::vector<std::wstring>> index;
+            hashing.SetFilter(&filter);
+            hashing.SetSpillBuilder(spillBuilder.get());
+            hashing.SetFilterBuilder(filterBuilder.get());
+            CFlatHashIndex index;
+
+            // Ask user whether to run as a background job limited to a number of directory reads per second
+            while (true)
+            {
+                std::wstring rateText;
+                double rate = 0;
+                std::cout << "Enter background read limit in directories per second (blank for foreground indexing): ";
+                std::getline(std::wcin, rateText);
+                if (rateText.empty())
+                {
+                    break;
+                }
+                if (bParseRate(rateText, rate))
+                {
+                    // Background jobs also back off whenever enumeration calls slow down past 10 ms
+                    ThrottleConfig throttle;
+                    throttle.priority = IoPriority::Idle;
+                    throttle.maxDirectoriesPerSecond = rate;
+                    throttle.latencyTargetMicroseconds = 10000;
+                    hashing.SetThrottle(throttle);
+                    break;
+                }
+                std::cout << "Enter a number of directories per second greater than 0" << std::endl;
+            }
+
+            // Ask user for a journal; a run killed partway resumes from it instead of from the root
+            std::wstring journalPath;
+            std::cout << "Enter a journal file to checkpoint to and resume from (blank for none): ";
+            std::getline(std::wcin, journalPath);
+            std::unique_ptr<CIndexJournal> journal;
+            if (!journalPath.empty())
+            {
+                journal.reset(new CIndexJournal(journalPath, directory));
+                hashing.SetJournal(journal.get());
+            }
 
             // Record the starting time of the indexing process
             auto start = std::chrono::high_resolution_clock::now();
 
             // Index files in the directory using hashing method
-            hashing.vListFilesInDirectoryH(directory, index, fileCount);
+            bool completed = hashing.vListFilesInDirectoryH(directory, index, fileCount);
 
-            // Print the index
-            hashing.print_index(index, fileCount);
+            // A failed walk leaves a partial index; discard its spilled runs and filters rather than persist them
+            if (!completed)
+            {
+                spillBuilder.reset();
+                filterBuilder.reset();
+                std::cerr << "Error: indexing did not complete; no index was written" << std::endl;
+            }
+            // Merge the spilled runs into the persisted index, otherwise print it
+            else if (spillBuilder)
+            {
+                spillBuilder->Finish(indexPath);
+                CFuzzyNameIndex::WriteSidecar(indexPath);
+                std::wcout << L"Indexed " << fileCount << L" files into " << indexPath << std::endl;
+            }
+            else
+            {
+                hashing.print_index(index, fileCount);
+            }
+
+            // The index is complete, so the checkpoints are no longer needed; a failed walk keeps them for the next run
+            if (journal && completed)
+            {
+                std::cout << "Resumed from " << journal->RecoveredCount() << " journaled directories." << std::endl;
+                journal->Complete();
+            }
 
             // Record the ending time of the indexing process
             auto end = std::chrono::high_resolution_clock::now();
@@ -142,6 +380,114 @@ int main()
 
             break;
         }
+        // If user chooses the compile-time specialized pipeline
+        case 4:
+        {
+            // Ask which index the pipeline should build
+            int method;
+            std::cout << "Press 1 for binary tree, 2 for btree-search, 3 for hashing" << std::endl;
+            std::cin >> method;
+            if (method < 1 || method > 3)
+            {
+                std::cout << "Enter a valid choice" << std::endl;
+                break;
+            }
+
+            // The facade picks the specialized pipeline once; the per-file path has no virtual calls
+            CIndexerFacade facade(static_cast<IndexMethod>(method), &filter);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            size_t indexed = 0;
+            try
+            {
+                indexed = facade.IndexDirectory(directory);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+                break;
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            facade.PrintIndex();
+
+            std::cout << "Total files: " << indexed << std::endl;
+            std::cout << "Time taken to index files: " << duration << " nanoseconds" << std::endl;
+
+            break;
+        }
+        // If user chooses lazy on-demand indexing
+        case 5:
+        {
+            // Nothing is walked up front; each query reads only the directories it reaches
+            std::unique_ptr<CLazyIndex> lazyIndex;
+            try
+            {
+                lazyIndex.reset(new CLazyIndex(directory, &filter));
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+                break;
+            }
+
+            // Answer queries until a blank line is entered
+            std::wstring query;
+            while (true)
+            {
+                std::cout << "Enter a query (ls:<dir>, find:<name>;<dir>) or leave blank to finish: ";
+                if (!std::getline(std::wcin, query) || query.empty())
+                {
+                    break;
+                }
+
+                size_t colon = query.find(L':');
+                std::wstring kind = query.substr(0, colon);
+                std::wstring argument = (colon == std::wstring::npos) ? L"" : query.substr(colon + 1);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                if (kind == L"ls")
+                {
+                    std::vector<std::wstring> files, subdirectories;
+                    if (!lazyIndex->List(argument, files, subdirectories))
+                    {
+                        std::cout << "Directory not found" << std::endl;
+                        continue;
+                    }
+                    for (const auto& subdirectory : subdirectories)
+                    {
+                        std::wcout << L"  " << subdirectory << L"\\" << std::endl;
+                    }
+                    for (const auto& file : files)
+                    {
+                        std::wcout << L"  " << file << std::endl;
+                    }
+                }
+                else if (kind == L"find")
+                {
+                    // The directory after ';' scopes the search (the whole root when omitted)
+                    size_t separator = argument.find(L';');
+                    std::wstring name = argument.substr(0, separator);
+                    std::wstring scope = (separator == std::wstring::npos) ? L"" : argument.substr(separator + 1);
+                    for (const auto& path : lazyIndex->Find(scope, name))
+                    {
+                        std::wcout << L"  " << path << std::endl;
+                    }
+                }
+                else
+                {
+                    std::cout << "Enter a valid query" << std::endl;
+                    continue;
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+
+                std::cout << "Query took " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() << " nanoseconds; "
+                    << lazyIndex->ExpandedCount() << " directories read, " << lazyIndex->PlaceholderCount() << " still unexpanded" << std::endl;
+            }
+
+            break;
+        }
         // Default case if no valid choice is entered
         default:
         {
@@ -149,15 +495,252 @@ int main()
             break;
         }
         }
+
+        // Link the directories the walk collected into per-subtree filters and save them for later lookups
+        if (filterBuilder)
+        {
+            try
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                CSubtreeFilterIndex filterIndex;
+                filterBuilder->Finish(filterIndex);
+                filterIndex.Save(filterPath);
+                auto end = std::chrono::high_resolution_clock::now();
+
+                std::wcout << L"Subtree filters written to " << filterPath << std::endl;
+                std::cout << "Time taken to build the filters: " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() << " nanoseconds" << std::endl;
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
     }
     // If the user chooses to search files
     else if (choice1 == 2)
     {
-        // Create a DirectorySearch object and call its member functions
-        DirectorySearch<std::string> search;
-        search.getInput();    // Get user input
-        search.searchFiles(); // Search for files
-        search.printResult(); // Print the search result
+        // Ask user to choose between exact and typo-tolerant search
+        int searchChoice;
+        std::cout << "Press 1 for exact search" << std::endl;
+        std::cout << "Press 2 for fuzzy search" << std::endl;
+        std::cout << "Press 3 for exact name lookup using subtree filters" << std::endl;
+        std::cin >> searchChoice;
+
+        if (searchChoice == 3)
+        {
+            // Create a FilteredDirectorySearch object and call its member functions
+            FilteredDirectorySearch<std::string> search;
+            search.getInput();    // Get user input
+            search.searchFiles(); // Search for files
+            search.printResult(); // Print the search result
+        }
+        else if (searchChoice == 2)
+        {
+            // Create a FuzzyDirectorySearch object and call its member functions
+            FuzzyDirectorySearch<std::string> search;
+            search.getInput();    // Get user input
+            search.searchFiles(); // Search for files
+            search.printResult(); // Print the search result
+        }
+        else
+        {
+            // Create a DirectorySearch object and call its member functions
+            DirectorySearch<std::string> search;
+            search.getInput();    // Get user input
+            search.searchFiles(); // Search for files
+            search.printResult(); // Print the search result
+        }
+    }
+    // If the user chooses to compare two persisted indexes
+    else if (choice1 == 3)
+    {
+        // Ask user for the older and newer index files
+        std::wstring olderPath, newerPath;
+        std::cin.ignore();
+        std::cout << "Enter path of the older index file: ";
+        std::getline(std::wcin, olderPath);
+        std::cout << "Enter path of the newer index file: ";
+        std::getline(std::wcin, newerPath);
+
+        try
+        {
+            CIndexFileReader older(olderPath);
+            CIndexFileReader newer(newerPath);
+            CIndexDiff<CIndexFileReader, CIndexFileReader> diff;
+
+            auto start = std::chrono::high_resolution_clock::now();
+
+            // Print each difference as the merge finds it
+            size_t differences = diff.Compare(older, newer, [](const DiffEntry& entry)
+                {
+                    switch (entry.kind)
+                    {
+                    case DiffEntry::Kind::Added:
+                        std::wcout << L"Added:   " << entry.after.path << std::endl;
+                        break;
+                    case DiffEntry::Kind::Removed:
+                        std::wcout << L"Removed: " << entry.before.path << std::endl;
+                        break;
+                    case DiffEntry::Kind::Changed:
+                        std::wcout << L"Changed: " << entry.after.path << std::endl;
+                        break;
+                    case DiffEntry::Kind::Moved:
+                        std::wcout << L"Moved:   " << entry.before.path << L" -> " << entry.after.path << std::endl;
+                        break;
+                    }
+                });
+
+            auto end = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            std::cout << differences << " differences found" << std::endl;
+            std::cout << "Time taken to compare indexes: " << duration << " nanoseconds" << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
+    // If the user chooses to index several roots as independent shards
+    else if (choice1 == 4)
+    {
+        // Ask user for the roots to index
+        std::wstring rootList;
+        std::cin.ignore();
+        std::cout << "Enter directory paths separated by ';': ";
+        std::getline(std::wcin, rootList);
+
+        CShardedIndex shardedIndex;
+        for (const auto& root : vSplitPatterns(rootList))
+        {
+            ShardConfig config;
+            config.root = root;
+            shardedIndex.AddShard(config);
+        }
+
+        // Every shard builds on its own and is reported from its builder as it completes,
+        // so one slow mount delays neither the other reports nor the queries
+        std::mutex consoleMutex;
+        auto start = std::chrono::high_resolution_clock::now();
+        shardedIndex.SetCompletionCallback([&](size_t shard, ShardState state)
+            {
+                auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(consoleMutex);
+                std::wcout << std::endl << shardedIndex.Root(shard) << (state == ShardState::Ready ? L" indexed after " : L" failed after ")
+                    << duration << L" nanoseconds" << std::endl;
+            });
+        shardedIndex.BuildAll();
+
+        // Answer name queries across the shards that are ready until a blank line is entered
+        std::wstring query;
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(consoleMutex);
+                std::cout << "Enter part of a file name to search for, or leave blank to finish: " << std::flush;
+            }
+            if (!std::getline(std::wcin, query) || query.empty())
+            {
+                break;
+            }
+
+            size_t building = 0;
+            for (size_t shard = 0; shard < shardedIndex.ShardCount(); shard++)
+            {
+                if (shardedIndex.State(shard) == ShardState::Building) building++;
+            }
+
+            std::vector<IndexRecord> records = shardedIndex.FindByName(query);
+            std::lock_guard<std::mutex> lock(consoleMutex);
+            for (const auto& record : records)
+            {
+                std::wcout << L"  " << record.path << std::endl;
+            }
+            if (building > 0)
+            {
+                std::cout << building << " shard(s) still building; their files are not included yet" << std::endl;
+            }
+        }
+
+        // Let the remaining builds finish before the index goes away
+        shardedIndex.WaitAll();
+    }
+    else if (choice1 == 5)
+    {
+        // Ask user for the tree and the shape of the load
+        std::wstring directory, queryFile, scanAnswer;
+        BenchConfig config;
+        std::cin.ignore();
+        std::cout << "Enter directory path: ";
+        std::getline(std::wcin, directory);
+        while (true)
+        {
+            std::wstring countText;
+            std::cout << "Enter number of queries (blank for " << config.queryCount << "): ";
+            std::getline(std::wcin, countText);
+            if (countText.empty() || (bParseCount(countText, config.queryCount) && config.queryCount > 0))
+            {
+                break;
+            }
+            std::cout << "Enter a whole number of queries greater than 0" << std::endl;
+        }
+        while (true)
+        {
+            std::wstring threadText;
+            size_t threads = 0;
+            std::cout << "Enter number of concurrent query threads (blank for " << config.threads << "): ";
+            std::getline(std::wcin, threadText);
+            if (threadText.empty())
+            {
+                break;
+            }
+            if (bParseCount(threadText, threads) && threads > 0 && threads <= 1024)
+            {
+                config.threads = static_cast<unsigned>(threads);
+                break;
+            }
+            std::cout << "Enter a whole number of threads from 1 to 1024" << std::endl;
+        }
+        std::cout << "Enter a recorded query file (kind<TAB>text per line), or leave blank for a synthetic mix: ";
+        std::getline(std::wcin, queryFile);
+        std::cout << "Include directory search without an index (walks the tree per query)? (y/n): ";
+        std::getline(std::wcin, scanAnswer);
+
+        try
+        {
+            CQueryBench bench(config);
+            std::cout << "Loaded " << bench.LoadTree(directory, nullptr) << " files." << std::endl;
+            if (queryFile.empty())
+            {
+                bench.SynthesizeQueries();
+            }
+            else
+            {
+                bench.LoadQueries(queryFile);
+            }
+
+            // Every backend answers the same queries over the same files
+            CHashQueryBackend hashBackend;
+            CBtreeQueryBackend btreeBackend;
+            CBstQueryBackend bstBackend(false);
+            CBstQueryBackend shuffledBstBackend(true);
+            CScanQueryBackend scanBackend(directory, nullptr);
+
+            std::vector<BenchResult> results;
+            results.push_back(bench.Run(hashBackend));
+            results.push_back(bench.Run(btreeBackend));
+            results.push_back(bench.Run(bstBackend));
+            results.push_back(bench.Run(shuffledBstBackend));
+            if (!scanAnswer.empty() && (scanAnswer[0] == L'y' || scanAnswer[0] == L'Y'))
+            {
+                results.push_back(bench.Run(scanBackend));
+            }
+            CQueryBench::PrintResults(results);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
     }
     else
     {
@@ -5,6 +5,13 @@
 #include "dirent.h"
 #include <cstring>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <locale>
+#include <codecvt>
+#include "FuzzySearch.h"
+#include "IndexFile.h"
+#include "SubtreeFilter.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -115,4 +122,244 @@ public:
             cout << "\nFile(s) is not present" << endl;
         }
     }
+};
+
+// Derived class for typo-tolerant search over an index file or a directory tree
+template <typename T>
+class FuzzyDirectorySearch : public FileSearch<T>
+{
+public:
+    void getInput() override
+    {
+        cout << "Please enter the index file or directory to search: " << endl;
+        cin >> this->directoryPath;
+
+        cout << "Please enter the name to search: " << endl;
+        cin >> this->searchString;
+
+        cout << "Please enter the maximum number of typos: " << endl;
+        cin >> maxDistance;
+
+        // The walk rules only apply when a directory is given instead of an index file
+        wstring excludeList, linksAnswer;
+        cin.ignore();
+        cout << "Please enter patterns to exclude when walking a directory separated by ';', or leave blank: " << endl;
+        getline(wcin, excludeList);
+        cout << "Follow directory symbolic links and count hard-linked files once? (y/n, blank for no): " << endl;
+        getline(wcin, linksAnswer);
+        rules.excludePatterns = vSplitPatterns(excludeList);
+        rules.followLinks = rules.dedupHardlinks = (!linksAnswer.empty() && (linksAnswer[0] == L'y' || linksAnswer[0] == L'Y'));
+    }
+
+    void searchFiles() override
+    {
+        auto startTime = high_resolution_clock::now();
+
+        try
+        {
+            wstring_convert<codecvt_utf8<wchar_t>> converter;
+            wstring path = converter.from_bytes(this->directoryPath);
+
+            // Reuse a persisted index when one is given, otherwise walk the tree once
+            if (!loadIndexFile(path))
+            {
+                collectNames(path);
+            }
+
+            if (this->entryCount == 0)
+            {
+                throw runtime_error("Error: No entries found in directory!");
+            }
+
+            matches = nameIndex.Search(converter.from_bytes(this->searchString), maxDistance);
+            this->resultFound = !matches.empty();
+
+            // Print the best matches first
+            for (const auto& match : matches)
+            {
+                cout << converter.to_bytes(nameIndex.Path(match.fileId)) << " (distance " << match.distance << ")" << endl;
+            }
+
+            auto stopTime = high_resolution_clock::now();
+            auto duration = duration_cast<nanoseconds>(stopTime - startTime);
+
+            cout << "\nSearching time: " << duration.count() << " nanoseconds" << endl;
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+        }
+    }
+
+    void printResult() override
+    {
+        if (this->resultFound)
+        {
+            cout << "\n" << matches.size() << " similar file(s) found" << endl;
+        }
+        else
+        {
+            cout << "\nNo similar file(s) found" << endl;
+        }
+    }
+
+private:
+    // Returns false if the path is not an index file
+    bool loadIndexFile(const wstring& path)
+    {
+        // The fuzzy index written beside the index file avoids rebuilding the trigram postings
+        if (nameIndex.LoadSidecar(path))
+        {
+            this->entryCount = static_cast<int>(nameIndex.size());
+            return true;
+        }
+
+        try
+        {
+            CIndexFileReader reader(path);
+            IndexRecord record;
+            while (reader.Read(record))
+            {
+                nameIndex.Add(record.path);
+                this->entryCount++;
+            }
+            return true;
+        }
+        catch (const runtime_error&)
+        {
+            return false;
+        }
+    }
+
+    // Add every file below the directory to the name index, walking with an explicit stack so
+    // link cycles, excluded subtrees and the depth limit are handled as the indexing walkers do
+    void collectNames(const wstring& root)
+    {
+        CIndexFilter filter(rules);
+        CLinkTracker links(rules);
+        links.AddRoot(root);
+        vector<pair<wstring, int>> pending;
+        pending.push_back({ root, 0 });
+
+        while (!pending.empty())
+        {
+            auto current = move(pending.back());
+            pending.pop_back();
+
+            WIN32_FIND_DATA findFileData;
+            wstring searchPath = current.first + L"\\*";
+            HANDLE hFind = FindFirstFile(searchPath.c_str(), &findFileData);
+            if (hFind == INVALID_HANDLE_VALUE) continue;
+
+            do
+            {
+                // Ignore "." and ".." directories
+                if (wcscmp(findFileData.cFileName, L".") == 0 || wcscmp(findFileData.cFileName, L"..") == 0) continue;
+
+                wstring entryPath = current.first + L"\\" + findFileData.cFileName;
+                if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    if (!filter.bAcceptDirectory(findFileData, current.second + 1)) continue;
+                    if (links.bEnterDirectory(entryPath, findFileData)) pending.push_back({ move(entryPath), current.second + 1 });
+                }
+                else
+                {
+                    if (!filter.bAcceptFile(findFileData)) continue;
+                    uint64_t fileId;
+                    if (!links.bAcceptFile(entryPath, fileId)) continue;
+                    nameIndex.Add(entryPath);
+                    this->entryCount++;
+                }
+            } while (FindNextFile(hFind, &findFileData) != 0);
+
+            FindClose(hFind);
+        }
+    }
+
+    int maxDistance = 2;
+    FilterRules rules;
+    CFuzzyNameIndex nameIndex;
+    vector<FuzzyMatch> matches;
+};
+
+// Derived class answering "is there a file named X" with per-subtree xor filters
+template <typename T>
+class FilteredDirectorySearch : public FileSearch<T>
+{
+public:
+    void getInput() override
+    {
+        cout << "Please enter the directory or subtree filter file to search: " << endl;
+        cin >> this->directoryPath;
+
+        cout << "Please enter the file name to look for: " << endl;
+        cin >> this->searchString;
+
+        // Lookups can be scoped to any directory the filters cover
+        cin.ignore();
+        cout << "Please enter the subtree to search under (blank for the whole tree): " << endl;
+        getline(cin, subtreePath);
+    }
+
+    void searchFiles() override
+    {
+        try
+        {
+            wstring_convert<codecvt_utf8<wchar_t>> converter;
+            wstring path = converter.from_bytes(this->directoryPath);
+
+            // A filter file saved while indexing answers without walking anything; otherwise the
+            // filters are built here and that walk is reported separately
+            auto buildStartTime = high_resolution_clock::now();
+            if (!filterIndex.Load(path))
+            {
+                filterIndex.Build(path);
+                auto buildDuration = duration_cast<nanoseconds>(high_resolution_clock::now() - buildStartTime);
+                cout << "No subtree filter file given; building the filters took " << buildDuration.count() << " nanoseconds" << endl;
+            }
+
+            wstring subtree = subtreePath.empty() ? filterIndex.RootPath() : converter.from_bytes(subtreePath);
+            if (!filterIndex.bContains(subtree))
+            {
+                throw runtime_error("Error: The subtree is not part of the indexed tree!");
+            }
+
+            auto startTime = high_resolution_clock::now();
+
+            vector<wstring> directories = filterIndex.Find(converter.from_bytes(this->searchString), subtree);
+            this->entryCount = static_cast<int>(directories.size());
+            this->resultFound = !directories.empty();
+
+            for (const auto& directory : directories)
+            {
+                cout << converter.to_bytes(directory) << endl;
+            }
+
+            auto stopTime = high_resolution_clock::now();
+            auto duration = duration_cast<nanoseconds>(stopTime - startTime);
+
+            cout << filterIndex.PrunedSubtrees() << " subtree(s) skipped by their filters" << endl;
+            cout << "\nSearching time: " << duration.count() << " nanoseconds" << endl;
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+        }
+    }
+
+    void printResult() override
+    {
+        if (this->resultFound)
+        {
+            cout << "\nFile(s) is present" << endl;
+        }
+        else
+        {
+            cout << "\nFile(s) is not present" << endl;
+        }
+    }
+
+private:
+    CSubtreeFilterIndex filterIndex;
+    string subtreePath;
 };
\ No newline at end of file